@@ -0,0 +1,48 @@
+#ifndef BUCKETS_H_
+#define BUCKETS_H_
+
+namespace Terran {
+
+// The bucket of coordinate x against the count sorted cuts of one dimension:
+// the number of cuts at or below x. In periodic dimensions coordinates past the
+// last cut wrap around to bucket 0. The comparison is !(x < cut) rather than
+// x >= cut so that NaN lands past the last cut, like +inf.
+//
+// Cluster, TreeFile and CompiledTree all find buckets through this function,
+// so a point falls into the same cell wherever it is classified.
+inline int findBucket(double x, const double* cuts, int count, bool periodic) {
+    int b = 0;
+    if(count <= 16) {
+        for(int j = 0; j < count; j++) {
+            b += !(x < cuts[j]);
+        }
+    } else {
+        // branchless binary search, every point takes the same log2(count) steps
+        const double *base = cuts;
+        int length = count;
+        while(length > 1) {
+            const int half = length/2;
+            base = !(x < base[half]) ? base+half : base;
+            length -= half;
+        }
+        b = (base-cuts)+!(x < *base);
+    }
+    return periodic && b == count ? 0 : b;
+}
+
+// How many buckets apart buckets a and b of one dimension are. A periodic
+// dimension with count cuts has count buckets around a circle, so the distance
+// there is measured the shorter way round.
+//
+// A point that falls into a cell of a divided node that held no points goes to
+// the child whose cell is nearest, summing this distance over the dimensions.
+// Ties go to the first such child. ClusterTree::insert(), TreeFile and
+// CompiledTree all follow this rule.
+inline int bucketDistance(int a, int b, int count, bool periodic) {
+    const int distance = a > b ? a-b : b-a;
+    return periodic && count-distance < distance ? count-distance : distance;
+}
+
+}
+
+#endif
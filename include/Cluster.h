@@ -6,6 +6,7 @@
 
 #include "export.h"
 #include "Param.h"
+#include "Dataset.h"
 #include "Partitioner.h"
 
 namespace Terran {
@@ -18,6 +19,20 @@ public:
     
 	Cluster(const std::vector<std::vector<double> > &data, const std::vector<int> &period);
 
+    // a view over count rows of data without copying any coordinates. Both
+    // data and rows must outlive the cluster, a NULL rows selects the first
+    // count points. The points are not validated again, the periodicity is
+    // taken from data.
+	Cluster(const Dataset &data, const int* rows, int count, Partitioner* partitioner);
+
+	Cluster(const Dataset &data, const int* rows, int count);
+
+    // the same views seeded with seed rather than from rand(), as if setSeed()
+    // had been called, but without drawing the subsample twice
+	Cluster(const Dataset &data, const int* rows, int count, Partitioner* partitioner, unsigned long long seed);
+
+	Cluster(const Dataset &data, const int* rows, int count, unsigned long long seed);
+
     // todo: delete partitions!
     ~Cluster();
 
@@ -33,13 +48,14 @@ public:
     // return point n of length D
     std::vector<double> getPoint(int n) const;
 
-    // return marginalized values for dimension d of length N
+    // return marginalized values for dimension d of length subsampleCount,
+    // every dimension is sampled at the same rows
     std::vector<double> getDimension(int d) const;
     
     // returns the partition for dimension d
     std::vector<double> getPartition(int d) const;
 
-    // set the partition info explicitly for dimension d
+    // set the partition info explicitly for dimension d, p must be sorted
     void setPartition(int d, const std::vector<double> &p);
 
     // set the partition method. Currently supported: "EM", possible "KDE" in the future
@@ -51,44 +67,94 @@ public:
 	// partition every dimension
 	void partitionAll();
 
+	// partitions dimensions in order of decreasing multimodality() of their
+	// subsample until maxSplits of them split the cluster, so that most EM fits
+	// are skipped on high dimensional data. The remaining dimensions get an
+	// empty partition. With maxSplits <= 0 every dimension is partitioned.
+	void partitionGreedy(int maxSplits);
+
     // returns an assignment of points into clusters
     // each dimension must have been partitioned either by means of:
     // setPartitions() or invoking partition()
     std::vector<int> assign();
 
+    // seeds the subsample and the partitioner of every dimension, which are
+    // otherwise seeded from rand() on construction. Redraws the subsample.
+    void setSeed(unsigned long long seed);
+
+    // iterations spent by the partitioner in every call to partition() and
+    // partitionAll() so far
+    long long getIterations() const;
+
     void setSubsampleCount(int count);
 
     int getSubsampleCount() const;
 
 	Partitioner& getPartitioner();
 
+    // finds the buckets of count coordinates x against the sorted cuts of one
+    // dimension. A coordinate falls into the bucket numbered by the cuts at or
+    // below it; in periodic dimensions coordinates past the last cut wrap
+    // around to bucket 0. See findBucket() in Buckets.h.
+    static void findBuckets(const double* x, int count, const std::vector<double> &cuts, bool periodic, int* buckets);
+
 private:
 	
-	void initialize();
+	void initialize(unsigned long long seed);
+
+    // partitions the listed dimensions concurrently, then throws the first error
+    void partitionDimensions(const std::vector<int> &dims);
+
+    // partitions the listed dimensions as a set of tasks, recording the exception 
+    // message of each dimension that fails and the iterations of each one
+    void partitionTasks(const std::vector<int> &dims, std::vector<std::string> &errors, std::vector<int> &iterations);
+
+    // true if the partition of dimension d divides the cluster
+    bool isSplit(int d) const;
+
+    // draws the subsampleCount_ rows shared by every call to getDimension()
+    void drawSubsample();
+
+    // getDimension() into a buffer owned by the calling thread, valid until
+    // the thread calls it again
+    const std::vector<double>& gatherDimension(int d) const;
+
+    // coordinate d of point n of this cluster
+    double getValue(int n, int d) const;
+
+    // assign() for partitions with too many hypercubes to encode in 64 bits
+    std::vector<int> assignByMap() const;
 
-    // assigns a given point to a bucket
-    std::vector<short> findBucket(int point) const;
 
     std::string partitionMethod_;
 
     // number of points used to subsample
     int subsampleCount_;
 
-    // points are stored in dataset, size N x D
-    // change to array of array later for performance
-    const std::vector<std::vector<double> > dataset_;
+    // sorted indices of the subsampled points
+    std::vector<int> subsample_;
+
+    // every random number of this cluster derives from seed_
+    unsigned long long seed_;
+
+    long long iterations_;
+
+    // points are stored in dataset, size N x D, column-major. Clusters built
+    // from raw points own their dataset, views point into a parent's dataset.
+    const Dataset ownedDataset_;
+
+    const Dataset* dataset_;
+
+    // rows of dataset_ that belong to this cluster, NULL if all of them
+    const int* rows_;
+
+    int numPoints_;
 
 	// of size d, partitionFlag_[d] is true if dimension d
 	// has been partitioned, false otherwise.
 	// all dimensions must have been partitioned at least once
 	std::vector<bool> partitionFlag_;
 
-    // describes the domain of each dimension
-    // period of 0 indicates the dimension is not periodic
-
-	// enforce period of 2PI.
-    const std::vector<int> period_;
-
     // disjoint partitions of each domain
     std::vector<std::vector<double> > partitions_;  
 
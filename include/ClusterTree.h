@@ -1,8 +1,10 @@
 #include <vector>
 #include <queue>
+#include <string>
 
 #include "export.h"
 #include "Cluster.h"
+#include "CompiledTree.h"
 
 /* A BFS based ClusterTree class. 
 
@@ -20,7 +22,8 @@
                           / \     / \
                          0   1   0   1
 
- Each level of the BFS tree uses at most O(N*d) space.
+ The tree stores a single permutation of the N points in which every node's
+ points form a contiguous range, so it uses O(N) space besides the nodes.
 
  */
 namespace Terran {
@@ -29,27 +32,69 @@ class TERRAN_EXPORT ClusterTree {
 
 public:
 
+    // running sums of features of a set of points, used by insert() to notice
+    // that new points changed a leaf's marginals. A dimension x contributes
+    // the features x and x^2, a periodic one cos x, sin x, cos 2x and sin 2x.
+    struct Moments {
+        Moments() : count(0) {};
+        double count;
+        std::vector<double> sum;
+        std::vector<double> sumSquares;
+    };
+
+    // nodes live in one array in BFS order, the root is node 0
     struct Node {
-        Node() {};
-        ~Node() {
-            for(int i=0;i<children.size(); i++) {
-                delete children[i];
-                children[i] = NULL;
-            }
-                
-        };
-        // points that belong to this cluster
-        std::vector<int> indices; 
-        // partition dividers
+        Node() : begin(0), end(0), firstChild(0), numChildren(0), seed(0) {};
+        // the points of this cluster are permutation_[begin, end)
+        int begin;
+        int end;
+        // the children of this node are nodes [firstChild, firstChild+numChildren)
+        int firstChild;
+        int numChildren;
+        // the cuts of each dimension that divided this node, empty until then
         std::vector<std::vector<double> > partitions;
-        // the clusters results from this
-        std::vector<Node*> children;
+        // the bucket of each dimension this node covers within its parent's
+        // partitions, see Cluster::findBuckets(). Empty for the root.
+        std::vector<int> buckets;
+        // seeds the cluster of this node, children derive theirs from it
+        unsigned long long seed;
+        // points insert()ed into this leaf that are not yet in its range
+        std::vector<int> pending;
+        // features of the points in the range, gathered when the node becomes
+        // a leaf during a build, and of the pending points
+        Moments reference;
+        Moments inserted;
+    };
+
+    // order in which a budgeted build() divides the queued clusters
+    enum Priority { LARGEST_FIRST, HIGHEST_VARIANCE_FIRST };
+
+    // limits of build(), a limit of 0 is unlimited
+    struct Budget {
+        Budget() : seconds(0), nodes(0), iterations(0), priority(LARGEST_FIRST) {};
+        // wall clock time in seconds
+        double seconds;
+        // number of clusters partitioned
+        int nodes;
+        // partitioner iterations, such as EM steps, summed over all clusters
+        long long iterations;
+        Priority priority;
     };
 
     // dataset: NxD matrix, N is number of points, D is dimension
     // period denotes the periodicity 
     ClusterTree(const std::vector<std::vector<double> > &dataset, const std::vector<int> &isPeriodic);
 
+    // a tree over an existing dataset, which is copied. Copying a dataset that
+    // is a view over caller memory copies only the view, so the memory must
+    // outlive the tree.
+    explicit ClusterTree(const Dataset &dataset);
+
+    // resumes a tree written by save() with its permutation, over the dataset
+    // it was built on. Queued clusters stay queued, so build() or step()
+    // continue where the saved tree stopped.
+    ClusterTree(const Dataset &dataset, const std::string &filename);
+
     ~ClusterTree();
 
 	// compute the centroid of the first k most populated cluster
@@ -77,8 +122,8 @@ public:
 
     // the step function is convenience function that does the following
     // 1. see if the queue is empty, if not, pop the head and set it as the currentCluster
-    // 2. if the currentCluster has less than 500 points, then mark as "finished"
-    // 3. partition each dimension in currentCluster using simpleRun()
+    // 2. if the currentCluster has no more than getMinSplitSize() points, then mark as "finished"
+    // 3. partition the dimensions of currentCluster with partitionGreedy(getMaxSplits())
     // 4. it divides the current cluster into subcluster
     // for fine tuned control, all four steps can be reconfigured as needed
     void step();
@@ -91,6 +136,56 @@ public:
 	// cannot be called twice in a row
     void setCurrentCluster(Partitioner* partitioner = NULL);
 
+    // processes the queued clusters and their descendants, splitting clusters
+    // with more than getMinSplitSize() points, until the queue is empty or the
+    // budget runs out. Independent nodes are partitioned concurrently as OpenMP
+    // tasks. Each node draws its random numbers from its own seed, so a node is
+    // divided exactly as by setCurrentCluster(), partitionGreedy(getMaxSplits())
+    // and divideCurrentCluster(), and without a budget the tree is identical.
+    //
+    // With a budget the clusters of highest priority go first, in waves of as
+    // many clusters as there are threads. The budget is checked between waves,
+    // and the clusters left over stay queued for a later build() or step().
+    // Returns true if the queue was emptied.
+    bool build(const Budget &budget = Budget());
+
+    // clusters with more than count points are divided further by step() and
+    // build(), defaults to 3000
+    void setMinSplitSize(int count);
+
+    int getMinSplitSize() const;
+
+    // step() and build() stop partitioning the dimensions of a cluster once
+    // count of them split it, see Cluster::partitionGreedy(). Defaults to 0,
+    // which partitions every dimension.
+    void setMaxSplits(int count);
+
+    int getMaxSplits() const;
+
+    // adds points to the dataset and routes each through the cuts of the
+    // tree to a leaf; points in a cell that held no points go to the child of
+    // the nearest cell, see bucketDistance(). A leaf that is not queued is
+    // divided again once it has more than getMinSplitSize() points and either
+    // did not have them before, or the mean of a feature of its new points
+    // (see Moments) is more than getDriftTolerance() standard errors from that
+    // of its old ones. Only those leaves and their descendants are partitioned, so the
+    // cost grows with the new points rather than the dataset. Cluster numbers
+    // may change. Returns the number of leaves divided again.
+    int insert(const std::vector<std::vector<double> > &points);
+
+    // defaults to 5
+    void setDriftTolerance(double sigmas);
+
+    double getDriftTolerance() const;
+
+    // writes the tree in the format described in TreeFile.h. Without the
+    // permutation the file can classify new points but cannot be resumed.
+    void save(const std::string &filename, bool permutation = true) const;
+
+    // a flat copy of the cuts and children of every divided node that
+    // classifies new points into the current clusters, see CompiledTree
+    CompiledTree compile() const;
+
 private:
 	
 	enum CalledFunction { NONE, SET_CURRENT_CLUSTER, DIVIDE_CURRENT_CLUSTER };
@@ -99,18 +194,93 @@ private:
     // returns a reference to the root of the BFS tree
     Node& getRoot();
 
-    void validateData();
-	
-    // returns found leaves so far
-    std::vector<const Node*> getLeaves() const;
-
-    // N x D
-    std::vector<std::vector<double> > dataset_; 
-    std::vector<int> period_;
-    std::queue<Node*> queue_;
-    Node* root_;
+    // checks that the leaves hold every point exactly once and agree with labels_
+    void validateData() const;
+
+    // sets up the root node holding every point
+    void initialize();
+
+    // restores the nodes, permutation and queue from a saved tree
+    void load(const std::string &filename);
+
+    // runs buildTasks() or buildWaves(), leaving unprocessed nodes in nodes
+    void buildNodes(std::vector<int> &nodes, const Budget &budget, std::string* error);
+
+    // spawns a task for each node, returns once they and their descendants are done
+    void buildTasks(const std::vector<int> &nodes, int count, std::string* error);
+
+    // partitions and divides node id, then spawns tasks for its children
+    void buildNode(int id, int count, std::string* error);
+
+    // divides nodes in order of priority until the budget runs out
+    void buildWaves(std::vector<int> &nodes, const Budget &budget, std::string* error);
+
+    // partitions and divides node id, returns the partitioner iterations spent
+    long long splitNode(int id, int count, std::vector<int> &ready, std::string* error);
+
+    // larger is divided first
+    double getPriority(int id, Priority priority) const;
+
+    // the range and seed of node id, safe while other tasks append to nodes_
+    void getRange(int id, int &begin, int &end, unsigned long long &seed) const;
+
+    // splits node id into the clusters found by cluster, reordering the node's
+    // range of permutation_ so that every child's points are contiguous. The
+    // children are appended to nodes_, and the ones with more than count points
+    // are appended to ready. Safe to call for different nodes concurrently.
+    void divideNode(int id, Cluster &cluster, int count, std::vector<int> &ready);
+
+    // reorders nodes_ into BFS order and rebuilds leaves_
+    void renumber();
+
+    // leaves_, rebuilt first if divideCurrentCluster() left it stale
+    const std::vector<int>& getLeaves() const;
+
+    // the leaf a point of the dataset falls into, buckets is scratch space of size D
+    int route(int n, std::vector<int> &buckets) const;
+
+    // true if the pending points of leaf id differ from its range, see insert()
+    bool hasDrifted(int id);
+
+    // adds the features of point n
+    void addMoments(Moments &moments, int n) const;
+
+    // adds the features of the points of other
+    void addMoments(Moments &moments, const Moments &other) const;
+
+    // moves leaf id and its pending points into a new range at the end of
+    // permutation_, leaving its old range unused
+    void layout(int id);
+
+    // appends the points of the subtree of node id to permutation with every
+    // node's points contiguous, recording each node's range in ranges. The
+    // pending points of leaves are included if pending is true.
+    void flatten(int id, bool pending, std::vector<int> &permutation, std::vector<int> &ranges) const;
+
+    // drops the unused ranges layout() leaves in permutation_
+    void compact();
+
+    // N x D, clusters of each node are views into it
+    Dataset dataset_; 
+    // every point exactly once, ordered so that each node's points form a
+    // contiguous range. Splitting a node only reorders that node's range.
+    // After insert() leaves may also hold pending points, and ranges moved by
+    // layout() leave unused slots until compact().
+    std::vector<int> permutation_;
+    // the leaf node holding each point, only the points of a node being
+    // divided are relabeled
+    std::vector<int> labels_;
+    std::vector<Node> nodes_;
+    // the nodes without children in BFS order, leaf i is cluster i. Read it
+    // through getLeaves(), which rebuilds it on first use after a step.
+    mutable std::vector<int> leaves_;
+    mutable bool leavesStale_;
+    std::queue<int> queue_;
     Cluster* currentCluster_;
-    Node* currentNode_;
+    int currentNode_;
+    int minSplitSize_;
+    int maxSplits_;
+    double driftTolerance_;
     
 };
 
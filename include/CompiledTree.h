@@ -0,0 +1,101 @@
+#ifndef COMPILED_TREE_H_
+#define COMPILED_TREE_H_
+
+#include <vector>
+
+#include "export.h"
+
+namespace Terran {
+
+class ClusterTree;
+class Dataset;
+
+/* A read-only copy of a ClusterTree's decisions, made by ClusterTree::compile(),
+   that labels points which were not part of the dataset.
+
+   Each divided node keeps its cut points in one flat array and maps the
+   buckets of a point straight to a child: small nodes through a table indexed
+   by the mixed radix code of the buckets, nodes with too many cells to
+   tabulate by binary search over their children's bucket tuples. Cells that
+   held no points go to the nearest child, see bucketDistance(). Nothing is
+   modified by classify(), so any number of threads may share a tree.
+*/
+class TERRAN_EXPORT CompiledTree {
+
+public:
+
+    // an empty tree with no dimensions
+    CompiledTree();
+
+    int getNumDimensions() const;
+
+    // number of leaves of the tree that was compiled
+    int getNumClusters() const;
+
+    // the cluster of a point of length D, with the same numbering as
+    // ClusterTree::assign(). A point in a cell of a divided node that held no
+    // points goes to the nearest child, as in ClusterTree::insert().
+    int classify(const double* point) const;
+
+    // classifies count points stored row-major, point i at points[i*D], into
+    // clusters[i]. Large batches are split into chunks across threads.
+    void classify(const double* points, int count, int* clusters) const;
+
+    void classify(const float* points, int count, int* clusters) const;
+
+    // classifies every point of a dataset into clusters[n], reading each
+    // point in place, so column-major and strided views need not be copied
+    void classify(const Dataset &points, int* clusters) const;
+
+private:
+
+    friend class ClusterTree;
+
+    struct Node {
+        // cluster number if this node is a leaf, -1 otherwise
+        int leaf;
+        int firstChild;
+        int numChildren;
+        // offset into tables_, -1 if the children are found by tuple search
+        int table;
+    };
+
+    // point[d] is coordinate d of the point
+    template<typename P>
+    int classifyPoint(const P &point) const;
+
+    // the child of node i nearest to the cell with buckets tuple
+    int nearestChild(int i, const int* tuple) const;
+
+    // points[n] is point n, as accepted by classifyPoint()
+    template<typename R>
+    void classifyBatch(const R &points, int count, int* clusters) const;
+
+    int numDimensions_;
+
+    int numClusters_;
+
+    std::vector<char> period_;
+
+    std::vector<Node> nodes_;
+
+    // the cuts of dimension d of node i are cuts_[cutStarts_[i*D+d], cutStarts_[i*D+d+1])
+    std::vector<int> cutStarts_;
+
+    std::vector<double> cuts_;
+
+    // code of a cell is the sum over d of its bucket times strides_[i*D+d]
+    std::vector<int> strides_;
+
+    // child node of each cell of a tabulated node, the nearest child for
+    // empty cells
+    std::vector<int> tables_;
+
+    // the bucket tuple each node covers within its parent, D per node
+    std::vector<int> buckets_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef DATASET_H_
+#define DATASET_H_
+
+#include <vector>
+#include <stddef.h>
+
+#include "export.h"
+
+namespace Terran {
+
+// An N x D point set. Built from points it keeps its own copy stored
+// column-major: the N values of each dimension sit in one contiguous block, and
+// every block starts on a 64 byte boundary so that marginal scans are
+// unit-stride and vectorizable. Built from a pointer it is a view that reads
+// the caller's double or float buffer in place, in any row/column layout.
+//
+// A Dataset is validated once when it is built: all points have the same
+// dimension and every periodic coordinate lies in [-PI, PI]. Clusters and
+// trees built on top of it do not check the points again.
+class TERRAN_EXPORT Dataset {
+
+public:
+
+    // an empty dataset with no points and no dimensions
+    Dataset();
+
+    // copies an N x D set of points, all points must have the same dimension
+    // and no dimension is periodic
+    explicit Dataset(const std::vector<std::vector<double> > &points);
+
+    // as above, period[d] is 1 if dimension d is periodic and 0 otherwise
+    Dataset(const std::vector<std::vector<double> > &points, const std::vector<int> &period);
+
+    // a view over caller memory, nothing is copied: coordinate d of point n is
+    // data[n*rowStride+d*columnStride], with strides counted in elements, so a
+    // row-major N x D buffer has rowStride D and columnStride 1. The memory must
+    // stay valid and unchanged while this dataset, or any copy of it, is in use.
+    Dataset(const double* data, int numPoints, int numDimensions, size_t rowStride, size_t columnStride, const std::vector<int> &period);
+
+    Dataset(const float* data, int numPoints, int numDimensions, size_t rowStride, size_t columnStride, const std::vector<int> &period);
+
+    // copying a view copies the view, not the memory it refers to
+    Dataset(const Dataset &other);
+
+    Dataset& operator=(const Dataset &other);
+
+    ~Dataset();
+
+    // returns number of points in the dataset
+    int getNumPoints() const {
+        return numPoints_;
+    }
+
+    // returns number of dimensions in the dataset
+    int getNumDimensions() const {
+        return numDimensions_;
+    }
+
+    // returns true if dimension d is periodic
+    bool isPeriodic(int d) const {
+        return period_[d] != 0;
+    }
+
+    // returns the periodicity of every dimension
+    const std::vector<int>& getPeriod() const {
+        return period_;
+    }
+
+    // returns the N contiguous values of dimension d, or NULL if the values
+    // are not stored as contiguous doubles
+    const double* getColumn(int d) const {
+        if(isFloat_ || rowStride_ != 1)
+            return NULL;
+        return (const double*) base_+d*columnStride_;
+    }
+
+    // returns coordinate d of point n
+    double operator()(int n, int d) const {
+        const size_t i = n*rowStride_+d*columnStride_;
+        return isFloat_ ? ((const float*) base_)[i] : ((const double*) base_)[i];
+    }
+
+    // copies coordinate d of points [first, first+count) into out
+    void gather(int d, int first, int count, double* out) const;
+
+    // copies coordinate d of the listed points into out
+    void gather(int d, const int* rows, int count, double* out) const;
+
+    // return point n of length D
+    std::vector<double> getPoint(int n) const;
+
+    // appends points of dimension D, validated as on construction. Owned
+    // storage grows geometrically so appending is amortized O(D) per point;
+    // a view is first copied into owned storage and stops reading the
+    // caller's memory. Pointers returned by getColumn() are invalidated.
+    void append(const std::vector<std::vector<double> > &points);
+
+private:
+
+    void allocate(int numPoints, int numDimensions);
+
+    void copyPoints(const std::vector<std::vector<double> > &points);
+
+    void copyFrom(const Dataset &other);
+
+    void setView(const void* data, bool isFloat, int numPoints, int numDimensions, size_t rowStride, size_t columnStride);
+
+    void validate() const;
+
+    int numPoints_;
+
+    int numDimensions_;
+
+    // storage of copied points, NULL for views. Room is left for
+    // columnStride_ points per dimension.
+    double* owned_;
+
+    // where the points are read from, either owned_ or the caller's memory
+    const void* base_;
+
+    bool isFloat_;
+
+    // distance in elements between consecutive points and between dimensions
+    size_t rowStride_;
+
+    size_t columnStride_;
+
+    std::vector<int> period_;
+
+};
+
+} // namespace Terran
+
+#endif
@@ -12,15 +12,23 @@
 #include <vector>
 #include <stdexcept>
 #include "Param.h"
+#include "Random.h"
 
 // Abstract Expectation Maximization class for Gaussian-like mixture models that 
-// optimize a set of initial parameters given a dataset. Concrete classes reimplement 
-// the M step as needed. 
+// optimize a set of initial parameters given a dataset. This is a thin virtual facade,
+// the E-step, M-step and likelihood are implemented once for each density model by 
+// EMCore<Model> (see EMCore.h), and concrete classes add the domain and merge rules.
 //
 // Ref 1. Estimating Gaussian Mixture Densities with EM - A Tutorial, Carlo Tomasi
 // 
 // In general, the size of the data need not be exceedingly large provided the underlying
 // data is well distributed. 
+//
+// The data is sorted once on construction or in setData(). A component whose mean is many standard
+// deviations away from a point contributes nothing to it, so each component only
+// needs to visit the contiguous window of sorted points within getCutoff() standard
+// deviations of its mean. The E and M steps only process these windows, which makes
+// an iteration cost roughly O(N*overlap) instead of O(N*K).
 
 namespace Terran {
 
@@ -32,6 +40,18 @@ class TERRAN_EXPORT EM {
         EM(const std::vector<double> &data);
         virtual ~EM();
 
+        // Replace the data, reusing the memory of the previous data. The current
+        // parameters are kept, so they can serve as the starting point of a new run.
+        void setData(const std::vector<double> &data);
+
+        // Restore the default settings and clear the parameters, as if the object
+        // had just been constructed on its current data. The random stream is kept.
+        void reset();
+
+        // Reseed the stream simpleRun() draws its initial means from. Without
+        // a seed the first simpleRun() seeds it from rand().
+        void setSeed(unsigned long long seed);
+
         // Set parameters
         void setParameters(const std::vector<Param> &input);
 
@@ -41,18 +61,31 @@ class TERRAN_EXPORT EM {
         // Get number of data points
         int getDataSize() const;
 
+        // The data, sorted in ascending order
+        const std::vector<double>& getData() const;
+
         // Set maximum number of steps in any given EM run
         void setMaxSteps(int maxSteps);
 
         // Get the maximum number of steps
         int getMaxSteps() const;
 
+        // Get the number of steps taken by the last run
+        int getNumSteps() const;
+
         // Set the tolerance for the log likelihood convergence criteria
         void setTolerance(double tol);
 
         // Return the tolerance
         double getTolerance() const;
 
+        // Set the number of standard deviations beyond which a component is 
+        // considered to have no support. Defaults to 10.
+        void setCutoff(double sigmas);
+
+        // Return the support cutoff in standard deviations
+        double getCutoff() const;
+
         // Runs the EM algorithm.
         // Notes:
         // -Requires parameters to be set explicitly
@@ -66,7 +99,7 @@ class TERRAN_EXPORT EM {
         bool simpleRun(unsigned int numParams);
 
 		// Compute the log likelihood given current parameters
-        double getLikelihood() const;
+        virtual double getLikelihood() const = 0;
 
         // Compute the Expectation based on current parameters
         virtual void EStep() = 0;
@@ -75,11 +108,30 @@ class TERRAN_EXPORT EM {
         virtual void MStep() = 0;
 
     protected:
+
+        // A run of sorted points [begin, end) lying within the cutoff of component k.
+        // r is the periodic image the window belongs to (0 for aperiodic models), and
+        // offset is the position of the window's first responsibility in the flattened
+        // responsibility buffer.
+        struct Window {
+            int k;
+            int r;
+            int begin;
+            int end;
+            int offset;
+        };
+
+        // Find the window [begin, end) of sorted points lying in [left, right]
+        void findWindow(double left, double right, int &begin, int &end) const;
 		       
 		// This is OK as it generally uses a tiny amount of space.
-        const std::vector<double> data_;
+        // Sorted in ascending order.
+        std::vector<double> data_;
         std::vector<Param> params_;
 
+        // support cutoff in standard deviations
+        double cutoff_;
+
     private:
 
         // maximum number of steps in each EM run
@@ -88,13 +140,23 @@ class TERRAN_EXPORT EM {
         // tolerance threshold
         double tolerance_;
 
+        // steps taken by the last run
+        int steps_;
+
+        // scratch space of run() and simpleRun(), kept between runs so that
+        // repeated runs do not allocate
+        std::vector<double> sample_;
+        std::vector<Param> paramsOld_;
+
+        Random random_;
+
+        // false until setSeed() or the first simpleRun() seeds random_
+        bool seeded_;
+
 		virtual void initializePink() = 0;
 
 		virtual void destroyPink() = 0;
 
-        // Used by the EStep to compute the expectation
-        virtual double qkn(int k, int n) const = 0;
-
         // Estimate the domain size
         virtual double domainLength() const = 0;
 
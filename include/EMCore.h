@@ -0,0 +1,346 @@
+#ifndef EM_CORE_H_
+#define EM_CORE_H_
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "EM.h"
+#include "MathFunctions.h"
+#include "FastMath.h"
+
+namespace Terran {
+
+// ------------
+// Density models
+// ------------
+//
+// A model describes how a single component with parameters (p, u, s) contributes
+// to the density at a point. Each component is a sum of images, image r being 
+// centered at u+r*period, and numImages is a compile time constant so the image 
+// loops can be unrolled. Component is constructed once per window and evaluated 
+// for every point in it, so it should precompute whatever it can.
+//
+// The M-step re-estimates u and s from the weighted moments of the points 
+// around each image, so models are expected to be gaussian-like. The models
+// evaluate exp() at the accuracy A of FastMath.h, by default the one the
+// library was built with.
+
+// Canonical gaussian
+template<FastMathAccuracy A = fastMathAccuracy> struct GaussianModel {
+
+    static const int numImages = 0;
+
+    struct Component {
+        Component(const Param &param, double center) :
+            center(center),
+            scale(param.p/(sqrt(2*PI)*param.s)),
+            exponent(-0.5/(param.s*param.s)) {}
+
+        double operator()(double x) const {
+            double dx = x-center;
+            return scale*fastExp<A>(exponent*dx*dx);
+        }
+
+        double center;
+        double scale;
+        double exponent;
+    };
+
+};
+
+// Wrapped gaussian approximated by its central image and NumImages images on either side
+template<int NumImages, FastMathAccuracy A = fastMathAccuracy> struct WrappedGaussianModel {
+
+    static const int numImages = NumImages;
+
+    typedef typename GaussianModel<A>::Component Component;
+
+};
+
+// OpenMP 4.5 taskloops split the E-step, M-step and likelihood into tasks that
+// idle threads of an enclosing parallel region (such as the one opened by
+// Cluster::partitionAll) can pick up. Outside of a parallel region, or without
+// taskloop support, the loops simply run on the calling thread.
+#if defined(_OPENMP) && _OPENMP >= 201511
+#define TERRAN_TASKLOOP _Pragma("omp taskloop default(shared)")
+#else
+#define TERRAN_TASKLOOP
+#endif
+
+// -----------
+// EM core
+// -----------
+//
+// Implements the E-step, M-step and likelihood of EM for a density model given as a
+// template parameter, so the loops over points are fully inlined and can be 
+// auto-vectorized. The EM base class remains the virtual facade.
+//
+// As described in EM.h, data_ is sorted and every image of every component only
+// visits the window of points within cutoff_ standard deviations of its center.
+// Per-point sums always run over the windows in the same order, and the
+// likelihood is reduced over fixed blocks of points, so results do not depend 
+// on the number of threads.
+template<class Model> class EMCore : public EM {
+
+    public:
+
+        void EStep();
+
+        void MStep();
+
+        double getLikelihood() const;
+
+    protected:
+
+        EMCore(const std::vector<double> &data, double period) :
+            EM(data),
+            period_(period) {}
+
+        EMCore(const std::vector<double> &data, const std::vector<Param> &params, double period) :
+            EM(data, params),
+            period_(period) {}
+
+        // period of the domain, ignored when Model has no images
+        double period_;
+
+    private:
+
+        void initializePink() {
+            density_.resize(data_.size());
+        }
+
+        void destroyPink() {
+            pink_.resize(0);
+            windows_.resize(0);
+            density_.resize(0);
+        }
+
+        // find the windows of every image of each component given the current
+        // params_, windows are ordered by component and empty ones are skipped
+        void findWindows(std::vector<Window> &windows) const;
+
+        // accumulate the density of every point covered by the windows, if pink
+        // is not NULL the value of every image at every point of its window is
+        // stored there as well
+        void accumulate(const std::vector<Window> &windows, double *density, double *pink) const;
+
+        // number of points handled by a single task
+        static const int blockSize = 256;
+
+        // pink_ holds p(k,r|n), the probability that point n came from image r 
+        // of component k, flattened over the windows_. This is updated during
+        // the E-step.
+        std::vector<double> pink_;
+
+        // windows used in the last E-step
+        std::vector<Window> windows_;
+
+        // mixture density of each point, accumulated over the windows
+        std::vector<double> density_;
+
+        // scratch space of the M-step and the likelihood. Like the buffers above
+        // these only grow, so iterations and repeated runs on data of similar 
+        // size do not allocate.
+        std::vector<int> groups_;
+        std::vector<Param> estimates_;
+        std::vector<char> supported_;
+        std::vector<Param> updated_;
+        mutable std::vector<Window> likelihoodWindows_;
+        mutable std::vector<double> likelihoodDensity_;
+        mutable std::vector<double> partial_;
+
+};
+
+template<class Model> void EMCore<Model>::findWindows(std::vector<Window> &windows) const {
+    windows.resize(0);
+    int offset = 0;
+    for(int k=0; k < params_.size(); k++) {
+        for(int r = -Model::numImages; r <= Model::numImages; r++) {
+            Window w;
+            w.k = k;
+            w.r = r;
+            double center = params_[k].u+r*period_;
+            findWindow(center-cutoff_*params_[k].s, center+cutoff_*params_[k].s, w.begin, w.end);
+            if(w.begin == w.end)
+                continue;
+            w.offset = offset;
+            offset += w.end-w.begin;
+            windows.push_back(w);
+        }
+    }
+}
+
+template<class Model> void EMCore<Model>::accumulate(const std::vector<Window> &windows, double *density, double *pink) const {
+    const double *x = &data_[0];
+    const int numWindows = windows.size();
+    if(pink) {
+        TERRAN_TASKLOOP
+        for(int i=0; i < numWindows; i++) {
+            const Window &w = windows[i];
+            const typename Model::Component component(params_[w.k], params_[w.k].u+w.r*period_);
+            double *q = pink+w.offset-w.begin;
+            for(int n=w.begin; n < w.end; n++) {
+                q[n] = component(x[n]);
+            }
+        }
+    }
+    const int numPoints = data_.size();
+    const int numBlocks = (numPoints+blockSize-1)/blockSize;
+    TERRAN_TASKLOOP
+    for(int b=0; b < numBlocks; b++) {
+        const int blockBegin = b*blockSize;
+        const int blockEnd = std::min(blockBegin+blockSize, numPoints);
+        for(int n=blockBegin; n < blockEnd; n++) {
+            density[n] = 0;
+        }
+        for(int i=0; i < numWindows; i++) {
+            const Window &w = windows[i];
+            const int begin = std::max(w.begin, blockBegin);
+            const int end = std::min(w.end, blockEnd);
+            if(begin >= end)
+                continue;
+            if(pink) {
+                const double *q = pink+w.offset-w.begin;
+                for(int n=begin; n < end; n++) {
+                    density[n] += q[n];
+                }
+            } else {
+                const typename Model::Component component(params_[w.k], params_[w.k].u+w.r*period_);
+                for(int n=begin; n < end; n++) {
+                    density[n] += component(x[n]);
+                }
+            }
+        }
+    }
+}
+
+template<class Model> void EMCore<Model>::EStep() {
+    findWindows(windows_);
+    pink_.resize(windows_.size() > 0 ? windows_.back().offset+windows_.back().end-windows_.back().begin : 0);
+    std::fill(density_.begin(), density_.end(), 0.0);
+    if(windows_.size() == 0)
+        return;
+    accumulate(windows_, &density_[0], &pink_[0]);
+
+    // replace the density by its inverse, points with a negligible density are 
+    // not attributed to any component
+    for(int n=0; n < density_.size(); n++) {
+        density_[n] = (density_[n] > 1e-7) ? 1.0/density_[n] : 0.0;
+    }
+    const int numWindows = windows_.size();
+    TERRAN_TASKLOOP
+    for(int i=0; i < numWindows; i++) {
+        const Window &w = windows_[i];
+        double *pink = &pink_[0]+w.offset-w.begin;
+        const double *inverse = &density_[0];
+        for(int n=w.begin; n < w.end; n++) {
+            pink[n] *= inverse[n];
+        }
+    }
+}
+
+template<class Model> void EMCore<Model>::MStep() {
+    const double *x = &data_[0];
+    // windows_ are grouped by component
+    std::vector<int> &groups = groups_;
+    groups.resize(0);
+    for(int i=0; i < windows_.size(); i++) {
+        if(i == 0 || windows_[i].k != windows_[i-1].k)
+            groups.push_back(i);
+    }
+    groups.push_back(windows_.size());
+    const int numGroups = groups.size()-1;
+    std::vector<Param> &estimates = estimates_;
+    estimates.resize(numGroups);
+    // a component with no points in its windows has no support left
+    std::vector<char> &supported = supported_;
+    supported.assign(numGroups, 0);
+
+    TERRAN_TASKLOOP
+    for(int g=0; g < numGroups; g++) {
+        const int first = groups[g];
+        const int last = groups[g+1];
+
+        // compute new probability and new mean
+        double sum = 0;
+        double numerator = 0;
+        for(int i=first; i < last; i++) {
+            const Window &w = windows_[i];
+            const double *pink = &pink_[0]+w.offset-w.begin;
+            const double shift = w.r*period_;
+            for(int n=w.begin; n < w.end; n++) {
+                sum += pink[n];
+                numerator += pink[n]*(x[n]-shift);
+            }
+        }
+        if(sum == 0)
+            continue;
+
+        Param param;
+        param.p = sum/data_.size();
+        param.u = numerator/sum;
+
+        // compute new standard deviation
+        numerator = 0;
+        for(int i=first; i < last; i++) {
+            const Window &w = windows_[i];
+            const double *pink = &pink_[0]+w.offset-w.begin;
+            const double center = param.u+w.r*period_;
+            for(int n=w.begin; n < w.end; n++) {
+                double a = x[n]-center;
+                numerator += pink[n]*(a*a);
+            }
+        }
+        param.s = sqrt(numerator/sum);
+        estimates[g] = param;
+        supported[g] = 1;
+    }
+
+    updated_.resize(0);
+    for(int g=0; g < numGroups; g++) {
+        if(supported[g])
+            updated_.push_back(estimates[g]);
+    }
+    params_.swap(updated_);
+}
+
+template<class Model> double EMCore<Model>::getLikelihood() const {
+    std::vector<Window> &windows = likelihoodWindows_;
+    findWindows(windows);
+    const int numPoints = data_.size();
+    std::vector<double> &density = likelihoodDensity_;
+    density.assign(numPoints, 0);
+    if(windows.size() > 0)
+        accumulate(windows, &density[0], NULL);
+    const int numBlocks = (numPoints+blockSize-1)/blockSize;
+    std::vector<double> &partial = partial_;
+    partial.resize(numBlocks);
+    TERRAN_TASKLOOP
+    for(int b=0; b < numBlocks; b++) {
+        double lambda = 0;
+        const int blockEnd = std::min(b*blockSize+blockSize, numPoints);
+        for(int n=b*blockSize; n < blockEnd; n++) {
+            // points outside of every window fall back to the full mixture
+            if(density[n] == 0) {
+                for(int k=0; k < params_.size(); k++) {
+                    for(int r = -Model::numImages; r <= Model::numImages; r++) {
+                        const typename Model::Component component(params_[k], params_[k].u+r*period_);
+                        density[n] += component(data_[n]);
+                    }
+                }
+            }
+            lambda += log(density[n]);
+        }
+        partial[b] = lambda;
+    }
+    double lambda = 0;
+    for(int b=0; b < numBlocks; b++) {
+        lambda += partial[b];
+    }
+    return lambda;
+}
+
+}
+
+#endif
@@ -1,40 +1,31 @@
 #ifndef EM_PERIODIC_GAUSSIAN_H
 #define EM_PERIODIC_GAUSSIAN_H
 
-#include "EM.h"
+#include "EMCore.h"
 #include "MathFunctions.h"
 
 namespace Terran {
 
 // Expectation Maximization of Periodic Gaussian Mixture Models
-class TERRAN_EXPORT EMPeriodicGaussian : public EM {
+// Each component is approximated by 7 images on either side of the central one.
+// The E/M step kernels evaluate exp() at accuracy A, see EMGaussianAt.
+template<FastMathAccuracy A> class TERRAN_EXPORT EMPeriodicGaussianAt : public EMCore<WrappedGaussianModel<7, A> > {
     public:
         
-        explicit EMPeriodicGaussian(const std::vector<double> &data, const std::vector<Param> &params, double period);
+        explicit EMPeriodicGaussianAt(const std::vector<double> &data, const std::vector<Param> &params, double period);
         
-        explicit EMPeriodicGaussian(const std::vector<double> &data, double period);
-        ~EMPeriodicGaussian();
-
-		void EStep();
-
-        void MStep();
+        explicit EMPeriodicGaussianAt(const std::vector<double> &data, double period);
+        ~EMPeriodicGaussianAt();
 
     private:
-
-		void initializePink();
-
-		void destroyPink();
-
-		std::vector<std::vector<std::vector<double> > > pinkr_;
         
         void mergeParams();
 
         double domainLength() const;
-
-        double qkn(int k, int n) const; 
-
-        double period_;
 };
 
+// at the accuracy the library was built with
+typedef EMPeriodicGaussianAt<fastMathAccuracy> EMPeriodicGaussian;
+
 }
 #endif
@@ -0,0 +1,81 @@
+#ifndef FAST_MATH_H_
+#define FAST_MATH_H_
+
+#include <math.h>
+#include <string.h>
+
+// Branch-free approximation of exp().
+//
+// It has no data dependent branches or table lookups, so loops that call it
+// can be auto-vectorized. It comes in a few accuracy tiers. FAST_MATH_1E6 and
+// FAST_MATH_1E12 bound its error relative to the true value. FAST_MATH_LIBM
+// forwards to the C library.
+//
+// Only the vectorized E/M step loops of EMCore use the approximation; called
+// one value at a time the polynomial is no faster than libm. The tier is
+// picked at build time with the CMake cache variable FAST_MATH_ACCURACY, which
+// defines one of
+//     TERRAN_FAST_MATH_1E6, TERRAN_FAST_MATH_1E12
+// and defaults to FAST_MATH_LIBM otherwise.
+
+namespace Terran {
+
+enum FastMathAccuracy { FAST_MATH_1E6, FAST_MATH_1E12, FAST_MATH_LIBM };
+
+#if defined(TERRAN_FAST_MATH_1E6)
+const FastMathAccuracy fastMathAccuracy = FAST_MATH_1E6;
+#elif defined(TERRAN_FAST_MATH_1E12)
+const FastMathAccuracy fastMathAccuracy = FAST_MATH_1E12;
+#else
+const FastMathAccuracy fastMathAccuracy = FAST_MATH_LIBM;
+#endif
+
+// exp(x) for x in [-708, 709]. Below -708 the result is 0 as exp() underflows
+// there anyway, above 709 the argument is clamped.
+//
+// x is reduced to x = n*ln2 + r with |r| <= ln2/2, exp(r) is evaluated with a
+// Taylor polynomial and 2^n is applied by writing n into the exponent bits.
+// The relative error is below 2e-7 (degree 6) and 1e-14 (degree 11).
+template<FastMathAccuracy A> inline double fastExp(double x) {
+    if(A == FAST_MATH_LIBM)
+        return exp(x);
+
+    const bool underflow = x < -708.0;
+    x = underflow ? -708.0 : x;
+    x = x > 709.0 ? 709.0 : x;
+
+    // adding 1.5*2^52 rounds x/ln2 to the nearest integer n, which ends up
+    // in the low bits of the mantissa of t
+    const double shift = 6755399441055744.0;
+    double t = x*1.4426950408889634074+shift;
+    double n = t-shift;
+    // ln2 split into a high and a low part, so r is exact
+    double r = x-n*6.93147180369123816490e-01-n*1.90821492927058770002e-10;
+
+    // 1/k!
+    static const double c[] = {
+        1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040,
+        1.0/40320, 1.0/362880, 1.0/3628800, 1.0/39916800
+    };
+    const int degree = (A == FAST_MATH_1E6) ? 6 : 11;
+    double p = c[degree];
+    for(int k=degree-1; k >= 0; k--) {
+        p = p*r+c[k];
+    }
+
+    long long bits;
+    memcpy(&bits, &t, sizeof(double));
+    bits = (bits-0x4338000000000000LL+1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(double));
+    return underflow ? 0.0 : p*scale;
+}
+
+// approximation at the accuracy selected for the library
+inline double fastExp(double x) {
+    return fastExp<fastMathAccuracy>(x);
+}
+
+}
+
+#endif
@@ -132,7 +132,8 @@ inline double fabsp(double x1, double x2, double period) {
 // The following 4 functions expression define gaussian, gaussian mixtures, and their derivatives
 
 inline double gaussian(double uk, double sk, double xn) {
-    return 1.0/(sqrt(2*PI)*sk)*exp(-(0.5)*pow((xn-uk)/sk,2));
+    double z = (xn-uk)/sk;
+    return 1.0/(sqrt(2*PI)*sk)*exp(-(0.5)*z*z);
 } 
 
 // These derivatives are not multiplied sqrt(2PI)
@@ -277,7 +278,8 @@ inline double periodicGaussianDx(double uk, double sk, double xn, double period,
     double prefactor = 1/(sqrt(2*PI)*sk*sk*sk);
     double sum = 0;
     for(int r=-numImages; r<=numImages; r++) {
-        sum += (uk-xn+r*period)*exp(-0.5*pow((xn-uk-r*period)/sk,2));
+        double z = (xn-uk-r*period)/sk;
+        sum += (uk-xn+r*period)*exp(-0.5*z*z);
     }
     return prefactor*sum;
 }
@@ -310,34 +312,10 @@ inline double periodicGaussianMixtureDx(const std::vector<Param> &params, double
 // Methods for sampling from 1D distributions
 // ------------------------------------------
 
-// draws a random sample from the periodic gaussian with mean u,
-// std. deviation s, and period period
-// assume x is in -period/2, period/2
-inline double periodicGaussianSample(double u, double s, double period) {
+// These use the global rand() stream and are meant for one-off draws. To draw
+// many samples from the same mixture use MixtureSampler instead.
 
-	if(s < 0.0002) {
-		throw(std::runtime_error("periodicGaussianSample() - s is too small"));
-	}
-
-    // sample between [0,1]
-    while(true) {
-        double x1 = (double) rand() / (double) RAND_MAX;
-        // move to [-0.5, 0.5]
-        x1 -= 0.5;
-        // move to [-0.5*2PI, -0.5*2PI]
-        x1 *= period;
-        // determine the probability of drawing x1
-        double probability = periodicGaussian(u, s, x1, period);
-        // make a random sample between 0 and 1 
-        double draw = (double) rand() / (double) RAND_MAX;
-        
-		if(draw < probability) {
-            return x1;
-        }
-    }
-}
-
-// draws a random sample from the periodic gaussian with mean u,
+// draws a random sample from the gaussian with mean u,
 // std. deviation s
 inline double gaussianSample(double u, double s) {
     
@@ -350,55 +328,53 @@ inline double gaussianSample(double u, double s) {
     return x;
 }
 
+// draws a random sample from the periodic gaussian with mean u,
+// std. deviation s, and period period
+// x is returned in [-period/2, period/2]
+inline double periodicGaussianSample(double u, double s, double period) {
+    // a wrapped normal sample is exact for any s
+    double x = gaussianSample(u, s);
+    return x-floor(x/period+0.5)*period;
+}
+
 // draw a random sample from the mixture params
-inline double gaussianMixtureSample(vector<Param> params) {
+inline double gaussianMixtureSample(const vector<Param> &params) {
 
-	// running sum of component probabilities
-	// (this can be cached if need be)
-	double cumulant = 0;
-	vector<double> running_sum(params.size());
-	for(int i=0; i < params.size(); i++) {
-		cumulant += params[i].p;
-		running_sum[i] = cumulant;
-	}
-	
 	double p1 = (double) rand() / (double) RAND_MAX;
 
+	// walk the running sum of component probabilities
+	double cumulant = 0;
 	int k = 0;
-    for(; k < running_sum.size(); k++) 
-        if(p1 <= running_sum[k])
+    for(; k < params.size(); k++) {
+		cumulant += params[k].p;
+        if(p1 <= cumulant)
             break;
+	}
 
     // avoid the overflow at the boundary due to numerical imprecision
-    if(k >= running_sum.size()) {
-        k = running_sum.size()-1;
+    if(k >= params.size()) {
+        k = params.size()-1;
     }
 
 	return gaussianSample(params[k].u, params[k].s);
 }
 
-inline double periodicGaussianMixtureSample(vector<Param> params, double period) {
+inline double periodicGaussianMixtureSample(const vector<Param> &params, double period) {
 
-	// running sum of component probabilities
-	// (this can be cached if need be)
-	double cumulant = 0;
-	vector<double> running_sum(params.size());
-	for(int i=0; i < params.size(); i++) {
-		cumulant += params[i].p;
-		running_sum[i] = cumulant;
-	}
-	
 	double p1 = (double) rand() / (double) RAND_MAX;
 
+	// walk the running sum of component probabilities
+	double cumulant = 0;
 	int k = 0;
-	
-	for(; k < running_sum.size(); k++) 
-		if(p1 <= running_sum[k])
+	for(; k < params.size(); k++) {
+		cumulant += params[k].p;
+		if(p1 <= cumulant)
 			break;
+	}
 
     // avoid the overflow at the boundary due to numerical imprecision
-	if(k >= running_sum.size()) {
-		k = running_sum.size()-1;
+	if(k >= params.size()) {
+		k = params.size()-1;
 	}
 
 	return periodicGaussianSample(params[k].u, params[k].s, period);
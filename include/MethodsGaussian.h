@@ -8,12 +8,18 @@
 
 namespace Terran {
 
+class MixtureSampler;
+
 class TERRAN_EXPORT MethodsGaussian : public Methods {
 
 public:
 
+    // brackets the extrema using samples seeded from rand()
     explicit MethodsGaussian(const std::vector<Param> &params);
 
+    // as above, with samples drawn from the given seed
+    MethodsGaussian(const std::vector<Param> &params, unsigned long long seed);
+
     // Partition the domain into disjoint intervals
     // std::vector<double> partition(double threshold) const;
 
@@ -25,6 +31,8 @@ public:
 
 private:
 
+	void findBrackets(MixtureSampler &sampler);
+
 	vector<Bracket> minBrackets_;
 	vector<Bracket> maxBrackets_;
 
@@ -8,13 +8,20 @@
 
 namespace Terran {
 
+class MixtureSampler;
+
 class TERRAN_EXPORT MethodsPeriodicGaussian : public Methods {
 
 public:
 
+    // brackets the extrema using samples seeded from rand()
     explicit MethodsPeriodicGaussian(const std::vector<Param> &params,
         double period);
 
+    // as above, with samples drawn from the given seed
+    MethodsPeriodicGaussian(const std::vector<Param> &params,
+        double period, unsigned long long seed);
+
     // Partition the domain into disjoint intervals
     // std::vector<double> partition(double threshold) const;
 
@@ -26,6 +33,8 @@ public:
 
 private:
 
+	void findBrackets(MixtureSampler &sampler);
+
 	const double period_;
 	vector<Bracket> maxBrackets_;
 
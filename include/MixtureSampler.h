@@ -0,0 +1,64 @@
+#ifndef MIXTURE_SAMPLER_H_
+#define MIXTURE_SAMPLER_H_
+
+#include <vector>
+
+#include "export.h"
+#include "Param.h"
+#include "Random.h"
+
+namespace Terran {
+
+// Draws samples from a gaussian or a wrapped (periodic) gaussian mixture.
+//
+// The sampler is built once per mixture. Components are selected in O(1) using
+// Vose's alias table, and periodic samples are drawn exactly by wrapping a normal
+// sample into [-period/2, period/2], so small standard deviations cost nothing extra.
+// Each sampler owns its random stream, so independent samplers may be used
+// concurrently from different threads.
+class TERRAN_EXPORT MixtureSampler {
+
+public:
+
+    // sampler for a gaussian mixture
+    explicit MixtureSampler(const std::vector<Param> &params);
+
+    // sampler for a periodic gaussian mixture
+    MixtureSampler(const std::vector<Param> &params, double period);
+
+    // reseed the random stream. Without a seed the first draw seeds it from
+    // rand().
+    void setSeed(unsigned long long seed);
+
+    // draw a single sample
+    double sample();
+
+    // fill samples with draws
+    void sample(std::vector<double> &samples);
+
+    // returns the period, 0 if the mixture is not periodic
+    double getPeriod() const;
+
+private:
+
+    void initialize();
+
+    const std::vector<Param> params_;
+
+    const double period_;
+
+    // alias table: component k is chosen with probability probability_[k],
+    // otherwise alias_[k] is chosen
+    std::vector<double> probability_;
+    std::vector<int> alias_;
+
+    Random random_;
+
+    // false until setSeed() or the first draw seeds random_
+    bool seeded_;
+
+};
+
+}
+
+#endif
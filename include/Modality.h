@@ -0,0 +1,27 @@
+#ifndef MODALITY_H_
+#define MODALITY_H_
+
+#include <vector>
+
+#include "export.h"
+
+namespace Terran {
+
+// Histogram based test for whether 1D data has more than one mode. It runs in
+// a single pass over the data and is far cheaper than an EM fit, so it is used
+// to decide which dimensions are worth fitting first.
+//
+// The data is binned into 2*cbrt(N) bins (Rice's rule) over [min, max], or
+// over [-PI, PI] if periodic. For every bin the depth of the valley it forms
+// is min(highest bin on its left, highest bin on its right) minus its count.
+// Bin counts are roughly Poisson, so each depth is measured in standard
+// deviations of the difference of the two counts. Periodic histograms are
+// treated cyclically.
+
+// the depth of the deepest valley in standard deviations, 0 if the histogram
+// has a single peak. Larger values are more clearly multimodal.
+TERRAN_EXPORT double multimodality(const std::vector<double> &data, bool periodic);
+
+}
+
+#endif
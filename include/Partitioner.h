@@ -31,6 +31,15 @@ public:
 	// return an unbound Partitioner
 	virtual Partitioner* clone(const std::vector<double> &data, bool isPeriodic) = 0;
 
+	// seed the random numbers used by the following calls to partition(), so
+	// that the partition is reproducible no matter which thread computes it.
+	// Deterministic partitioners can ignore it.
+	virtual void setSeed(unsigned long long /*seed*/) {};
+
+	// number of iterations spent by the last call to partition(), for
+	// partitioners that iterate. Used to budget the construction of trees.
+	virtual int getIterations() const { return 0; };
+
 protected:
 
     // The returned vector is defined as follows:
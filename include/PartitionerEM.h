@@ -31,7 +31,8 @@ public:
     // invokes optimizeParameters and findLowMinima
     std::vector<double> partition();
     
-	// get a curve of the model approximating the data in the range [left, right]
+	// get a curve of the model approximating the data in the range [left, right],
+	// throws if partition() has produced no model
 	void evaluateModel(std::vector<double> &x, std::vector<double> &y, int nsamples);
 
     EM& getEM();
@@ -44,8 +45,28 @@ public:
 
 	int getInitialK() const;
 
+	// Before fitting, partition() checks the data for a second mode with
+	// multimodality(). If no valley is deeper than tolerance standard
+	// deviations the data is taken to be unimodal and the empty partition is
+	// returned without running EM. The model of screened data is then a single
+	// component fitted to the mean and spread of the data. Screening is off by
+	// default, its tolerance defaults to 3.
+	void setScreening(bool enabled);
+
+	bool getScreening() const;
+
+	void setScreeningTolerance(double tolerance);
+
+	double getScreeningTolerance() const;
+
 	Partitioner* clone(const std::vector<double> &data, bool isPeriodic);
 
+	// seeds the initial means of the EM run and the search for minima
+	void setSeed(unsigned long long seed);
+
+	// number of EM steps taken by the last call to partition()
+	int getIterations() const;
+
 private:
 
 	// Executes EM::simpleRun()
@@ -62,6 +83,29 @@ private:
     // Minima whose value is less than partitionCutoff_ is 
     // considered to be a partition point
     double partitionCutoff_;
+
+    bool screening_;
+
+    double screeningTolerance_;
+
+    // true if the last call to partition() skipped EM
+    bool screened_;
+
+    // set by setSeed(), otherwise the EM object and the minima search draw
+    // from their own rand() seeded streams
+    bool hasSeed_;
+
+    unsigned long long seed_;
+
+    // EM objects are recycled between partitioners, see PartitionerEM.cpp
+    struct Workspace;
+    struct WorkspacePool;
+    static WorkspacePool pool_;
+
+    // taken from pool_ on the first call to setDataAndPeriod, returned on destruction
+    Workspace* workspace_;
+
+    // the EM object of workspace_ matching the current periodicity
     EM* em_; 
 
 
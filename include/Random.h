@@ -0,0 +1,94 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace Terran {
+
+// A small xorshift64* pseudo random number generator. Unlike rand(), each
+// instance carries its own state, so objects that own one produce reproducible
+// streams and can be used from several threads at once.
+class Random {
+
+public:
+
+    explicit Random(unsigned long long seed = 0) {
+        setSeed(seed);
+    }
+
+    // reset the stream, any seed (including zero) is valid
+    void setSeed(unsigned long long seed) {
+        // splitmix64 scrambles the seed so that nearby seeds give unrelated streams
+        unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        state_ = z ^ (z >> 31);
+        if(state_ == 0)
+            state_ = 0x9E3779B97F4A7C15ULL;
+        hasSpare_ = false;
+    }
+
+    // a seed drawn from rand(), for objects that were given no seed of their
+    // own. Their draws then stay reproducible under srand().
+    static unsigned long long seedFromRand() {
+        return ((unsigned long long) rand() << 31) ^ rand();
+    }
+
+    // seed of stream number stream derived from seed. Work that is split up,
+    // such as the dimensions of a cluster or the children of a tree node, draws
+    // from derived streams so the result does not depend on execution order.
+    static unsigned long long derive(unsigned long long seed, unsigned long long stream) {
+        return Random(seed + 0x632BE59BD9B4E019ULL*(stream+1)).next();
+    }
+
+    // uniformly distributed 64 bit integer
+    unsigned long long next() {
+        state_ ^= state_ >> 12;
+        state_ ^= state_ << 25;
+        state_ ^= state_ >> 27;
+        return state_ * 0x2545F4914F6CDD1DULL;
+    }
+
+    // uniformly distributed in [0, 1)
+    double uniform() {
+        return toUniform(next());
+    }
+
+    // maps the top 53 bits of a 64 bit integer to [0, 1). Adding anything to
+    // the 53 bits would round the largest of them up to exactly 1.
+    static double toUniform(unsigned long long bits) {
+        return (bits >> 11) * (1.0/9007199254740992.0);
+    }
+
+    // uniformly distributed integer in [0, bound)
+    int index(int bound) {
+        return (int) ((next() >> 33) * bound >> 31);
+    }
+
+    // standard normal sample using the Box-Muller transform, the second
+    // sample of each pair is kept for the next call
+    double normal() {
+        if(hasSpare_) {
+            hasSpare_ = false;
+            return spare_;
+        }
+        // 1-uniform() is in (0, 1], so the logarithm is finite
+        double radius = sqrt(-2*log(1-uniform()));
+        double angle = 6.283185307179586476925286766559*uniform();
+        spare_ = radius*sin(angle);
+        hasSpare_ = true;
+        return radius*cos(angle);
+    }
+
+private:
+
+    unsigned long long state_;
+    double spare_;
+    bool hasSpare_;
+
+};
+
+}
+
+#endif
@@ -1,13 +1,22 @@
+#include "Buckets.h"
 #include "Cluster.h"
 #include "ClusterTree.h"
+#include "CompiledTree.h"
+#include "Dataset.h"
 #include "EM.h"
+#include "EMCore.h"
 #include "EMGaussian.h"
 #include "EMPeriodicGaussian.h"
+#include "FastMath.h"
 #include "MathFunctions.h"
 #include "Methods.h"
 #include "MethodsGaussian.h"
 #include "MethodsPeriodicGaussian.h"
+#include "MixtureSampler.h"
+#include "Modality.h"
 #include "Param.h"
 #include "Partitioner.h"
 #include "PartitionerEM.h"
+#include "Random.h"
+#include "TreeFile.h"
 #include "export.h"
\ No newline at end of file
@@ -0,0 +1,138 @@
+#ifndef TREE_FILE_H_
+#define TREE_FILE_H_
+
+#include <string>
+
+#include "export.h"
+
+namespace Terran {
+
+/* The binary format ClusterTree::save() writes, and a read-only view of it.
+
+   A file starts with a TreeFileHeader, followed by sections at the offsets the
+   header lists, each aligned to 8 bytes:
+
+     period       numDimensions ints, 1 if the dimension is periodic
+     nodes        numNodes TreeFileNode records in BFS order, the root first
+     cutStarts    numNodes*numDimensions+1 unsigned long longs, the cuts of
+                  dimension d of node i are cuts[cutStarts[i*D+d], cutStarts[i*D+d+1])
+     cuts         the sorted cut points of every divided node, doubles
+     buckets      numNodes*numDimensions ints, the bucket of each dimension that
+                  node i covers within its parent (zeros for the root)
+     permutation  numPoints ints, optional: the points of node i are
+                  permutation[begin, end)
+
+   Numbers are stored in the byte order of the machine that wrote the file,
+   the loader rejects files whose byteOrder does not read back as 0x01020304.
+   The version is bumped whenever the layout changes.
+
+   TreeFile maps a file into memory and reads it in place, so opening even a
+   large tree costs no more than validating its header and node records.
+*/
+
+struct TreeFileHeader {
+    char magic[4];
+    unsigned int byteOrder;
+    unsigned int version;
+    unsigned int numDimensions;
+    unsigned int numNodes;
+    unsigned int flags;
+    unsigned long long numPoints;
+    unsigned long long numCuts;
+    unsigned long long periodOffset;
+    unsigned long long nodesOffset;
+    unsigned long long cutStartsOffset;
+    unsigned long long cutsOffset;
+    unsigned long long bucketsOffset;
+    unsigned long long permutationOffset;
+};
+
+struct TreeFileNode {
+    // the points of this node are permutation[begin, end)
+    int begin;
+    int end;
+    // the children of this node are nodes [firstChild, firstChild+numChildren)
+    int firstChild;
+    int numChildren;
+    // cluster number if this node is a leaf, -1 otherwise
+    int leaf;
+    // TreeFile::QUEUED if the node was still waiting to be processed
+    int flags;
+    unsigned long long seed;
+};
+
+class TERRAN_EXPORT TreeFile {
+
+public:
+
+    static const unsigned int VERSION = 1;
+
+    // header flags
+    static const unsigned int HAS_PERMUTATION = 1;
+
+    // node flags
+    static const int QUEUED = 1;
+
+    // maps filename into memory and validates its layout
+    explicit TreeFile(const std::string &filename);
+
+    ~TreeFile();
+
+    int getNumDimensions() const;
+
+    int getNumNodes() const;
+
+    int getNumPoints() const;
+
+    // number of leaves
+    int getNumClusters() const;
+
+    bool isPeriodic(int d) const;
+
+    const TreeFileNode& getNode(int i) const;
+
+    // the count sorted cuts of dimension d of node i
+    const double* getCuts(int i, int d, int &count) const;
+
+    // the bucket of each dimension that node i covers within its parent
+    const int* getBuckets(int i) const;
+
+    bool hasPermutation() const;
+
+    // NULL if the file has no permutation
+    const int* getPermutation() const;
+
+    // the cluster of a point of length numDimensions. A point in a cell of a
+    // divided node that held no points when the tree was built goes to the
+    // nearest child, as in ClusterTree::insert().
+    int classify(const double* point) const;
+
+private:
+
+    // not copyable
+    TreeFile(const TreeFile &);
+    TreeFile& operator=(const TreeFile &);
+
+    void unmap();
+
+    const char* data_;
+    unsigned long long size_;
+#ifdef _WIN32
+    void* file_;
+    void* mapping_;
+#endif
+
+    const TreeFileHeader* header_;
+    const int* period_;
+    const TreeFileNode* nodes_;
+    const unsigned long long* cutStarts_;
+    const double* cuts_;
+    const int* buckets_;
+    const int* permutation_;
+    int numClusters_;
+
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdexcept>
+#include <stdlib.h>
 #include <sstream>
 #include <map>
 #include <algorithm>
@@ -8,6 +9,9 @@
 #include "EMPeriodicGaussian.h"
 #include "EMGaussian.h"
 #include "PartitionerEM.h"
+#include "Random.h"
+#include "Modality.h"
+#include "Buckets.h"
 
 
 #include "omp.h"
@@ -17,22 +21,72 @@ using namespace std;
 
 namespace Terran {
 
+// The subsample of a dimension is gathered into a buffer of the calling thread
+// rather than a new vector. The buffer is only used until the partitioner or
+// multimodality() is done reading it, which involves no task scheduling point,
+// so no other task on the same thread can overwrite it meanwhile.
+struct DimensionBuffers {
+    ~DimensionBuffers() {
+        for(int i=0; i < buffers.size(); i++) {
+            delete buffers[i];
+        }
+    }
+    vector<vector<double>*> buffers;
+};
+
+static DimensionBuffers dimensionBuffers;
+
+static vector<double>* dimensionBuffer = NULL;
+#pragma omp threadprivate(dimensionBuffer)
+
+// below this many points assign() stays on the calling thread
+static const int parallelAssignCutoff = 32768;
+
+// thread queries that fall back to a single thread without OpenMP
+static int maxThreads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static int numThreads() {
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+static int threadNum() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
 Cluster::Cluster(const vector<vector<double> > &data, const vector<int> &period) : 
-    dataset_(data),
-    period_(period),
+    ownedDataset_(data, period),
+    dataset_(&ownedDataset_),
+    rows_(NULL),
+    numPoints_(data.size()),
     partitions_(period.size()),
 	partitionFlag_(period.size(), 0),
     subsampleCount_(min(3000,(int)data.size())) {
 
 	partitioner_ = new PartitionerEM();
 
-	initialize();
+	initialize(Random::seedFromRand());
 
 }
 
 Cluster::Cluster(const vector<vector<double> > &data, const vector<int> &period, Partitioner* partitioner) :
-    dataset_(data),
-    period_(period),
+    ownedDataset_(data, period),
+    dataset_(&ownedDataset_),
+    rows_(NULL),
+    numPoints_(data.size()),
     partitions_(period.size()),
 	partitionFlag_(period.size(), 0),
     subsampleCount_(min(3000,(int)data.size())),
@@ -42,41 +96,141 @@ Cluster::Cluster(const vector<vector<double> > &data, const vector<int> &period,
 		throw(std::runtime_error("Cluster::Cluster() - NULL partitioner passed into constructor"));
 	}
 
-	initialize();
+	initialize(Random::seedFromRand());
 
 }
 
-void Cluster::initialize() {
+Cluster::Cluster(const Dataset &data, const int* rows, int count) : 
+    dataset_(&data),
+    rows_(rows),
+    numPoints_(count),
+    partitions_(data.getNumDimensions()),
+	partitionFlag_(data.getNumDimensions(), 0),
+    subsampleCount_(min(3000,count)) {
+
+	partitioner_ = new PartitionerEM();
+
+	initialize(Random::seedFromRand());
+
+}
+
+Cluster::Cluster(const Dataset &data, const int* rows, int count, Partitioner* partitioner) :
+    dataset_(&data),
+    rows_(rows),
+    numPoints_(count),
+    partitions_(data.getNumDimensions()),
+	partitionFlag_(data.getNumDimensions(), 0),
+    subsampleCount_(min(3000,count)),
+	partitioner_(partitioner) {
 	
-	for(int i=0; i < period_.size(); i++) {
-		if(period_[i] != 1 && period_[i] != 0) {
-			throw(std::runtime_error("period must either be zero (false), or one (true)"));
-		}
+	if(partitioner == NULL) {
+		throw(std::runtime_error("Cluster::Cluster() - NULL partitioner passed into constructor"));
 	}
 
-	for(int n=1; n < dataset_.size(); n++) {
-		if(dataset_[n].size() != dataset_[n-1].size()) {
-			throw(std::runtime_error("Cluster::Cluster() - not all points have the same dimensions"));
-		}
-	}
+	initialize(Random::seedFromRand());
 
-	for(int n=0; n < dataset_.size(); n++) {
-		for(int d=0; d < dataset_[n].size(); d++) {
-			if(period_[d]) {
-				if(dataset_[n][d] < -PI || dataset_[n][d] > PI) {
-					stringstream error;
-					error << "Cluster::Cluster() - dimension " << d << " is periodic, but the angles are not in the range [-PI, to PI]" << endl;
-					throw(std::runtime_error(error.str()));
-				}
-			}
-		}
+}
+
+Cluster::Cluster(const Dataset &data, const int* rows, int count, unsigned long long seed) : 
+    subsampleCount_(min(3000,count)),
+    dataset_(&data),
+    rows_(rows),
+    numPoints_(count),
+	partitionFlag_(data.getNumDimensions(), 0),
+    partitions_(data.getNumDimensions()) {
+
+	partitioner_ = new PartitionerEM();
+
+	initialize(seed);
+
+}
+
+Cluster::Cluster(const Dataset &data, const int* rows, int count, Partitioner* partitioner, unsigned long long seed) :
+    subsampleCount_(min(3000,count)),
+    dataset_(&data),
+    rows_(rows),
+    numPoints_(count),
+	partitionFlag_(data.getNumDimensions(), 0),
+    partitions_(data.getNumDimensions()),
+	partitioner_(partitioner) {
+	
+	if(partitioner == NULL) {
+		throw(std::runtime_error("Cluster::Cluster() - NULL partitioner passed into constructor"));
 	}
-		
-    if(dataset_.size() == 0) 
+
+	initialize(seed);
+
+}
+
+// the points themselves were validated when the Dataset was built
+void Cluster::initialize(unsigned long long seed) {
+
+    if(numPoints_ <= 0) 
         throw(std::runtime_error("Cluster()::Cluster() - input data size cannot be 0"));
 
-    if(dataset_[0].size() != period_.size())
-        throw(std::runtime_error("Cluster()::Cluster() - period size does not match data dimension"));
+#ifndef NDEBUG
+    if(rows_ != NULL) {
+        for(int n=0; n < numPoints_; n++) {
+            if(rows_[n] < 0 || rows_[n] >= dataset_->getNumPoints())
+                throw(std::runtime_error("Cluster()::Cluster() - row index out of bounds"));
+        }
+    }
+#endif
+
+    seed_ = seed;
+    iterations_ = 0;
+	drawSubsample();
+}
+
+void Cluster::setSeed(unsigned long long seed) {
+    seed_ = seed;
+    drawSubsample();
+}
+
+// adds row to the hash set table, whose size is a power of two and which marks
+// free slots with -1. Returns false if row was already there.
+static bool insertRow(vector<int> &table, int row) {
+    const unsigned int mask = table.size()-1;
+    unsigned int i = ((unsigned int) row*2654435761u) & mask;
+    while(table[i] != -1) {
+        if(table[i] == row)
+            return false;
+        i = (i+1) & mask;
+    }
+    table[i] = row;
+    return true;
+}
+
+// Floyd's algorithm picks subsampleCount_ distinct rows with exactly that
+// many draws, so the cost does not depend on the number of points
+void Cluster::drawSubsample() {
+    const int N = getNumPoints();
+    subsample_.resize(subsampleCount_);
+    if(subsampleCount_ == N) {
+        for(int i=0; i < N; i++) {
+            subsample_[i] = i;
+        }
+        return;
+    }
+    Random random(Random::derive(seed_, 0));
+    // the chosen rows are kept in an open addressing hash set that is at most
+    // half full, so every draw costs O(1) and only the table is allocated
+    int size = 1;
+    while(size < 2*subsampleCount_) {
+        size <<= 1;
+    }
+    vector<int> table(size, -1);
+    subsample_.resize(0);
+    for(int j=N-subsampleCount_; j < N; j++) {
+        int t = random.index(j+1);
+        if(!insertRow(table, t)) {
+            // j has not been drawn yet, as earlier draws were all below j
+            insertRow(table, j);
+            t = j;
+        }
+        subsample_.push_back(t);
+    }
+    sort(subsample_.begin(), subsample_.end());
 }
 
 Cluster::~Cluster() {
@@ -84,22 +238,31 @@ Cluster::~Cluster() {
 }
 
 int Cluster::getNumDimensions() const {
-    return dataset_[0].size();
+    return dataset_->getNumDimensions();
 }
 
 int Cluster::getNumPoints() const {
-    return dataset_.size();
+    return numPoints_;
+}
+
+double Cluster::getValue(int n, int d) const {
+    return (*dataset_)(rows_ ? rows_[n] : n, d);
 }
 
 bool Cluster::isPeriodic(int d) const {
-	return period_[d];
+	return dataset_->isPeriodic(d);
 }
 
 void Cluster::setSubsampleCount(int count) {
-    if(count < getNumPoints()) {
-		throw(std::runtime_error("Cluster::setSubsampleCount() - subsample count can not be less than number of points")); 
+    if(count > getNumPoints() || count < 1) {
+		throw(std::runtime_error("Cluster::setSubsampleCount() - subsample count must be between 1 and the number of points")); 
 	}
 	subsampleCount_ = count;
+	drawSubsample();
+}
+
+long long Cluster::getIterations() const {
+    return iterations_;
 }
 
 int Cluster::getSubsampleCount() const {
@@ -110,19 +273,39 @@ vector<double> Cluster::getPoint(int n) const {
     if(n >= getNumPoints()) {
         throw(std::runtime_error("Cluster::getPoint() - n out of bounds!"));   
     }
-    return dataset_[n];
+    return dataset_->getPoint(rows_ ? rows_[n] : n);
 }
 
 vector<double> Cluster::getDimension(int d) const {
     if(d >= getNumDimensions()) {
         throw(std::runtime_error("Cluster::getDimension() - d out of bounds!"));   
     }
-    vector<double> data(getNumPoints());
-    for(int i=0; i<getNumPoints(); i++) {
-        data[i] = dataset_[i][d];
+    vector<double> data(subsample_.size());
+    if(rows_ != NULL) {
+        for(int i=0; i<subsample_.size(); i++) {
+            data[i] = (*dataset_)(rows_[subsample_[i]], d);
+        }
+    } else {
+        dataset_->gather(d, &subsample_[0], subsample_.size(), &data[0]);
+    }
+    return data;
+}
+
+const vector<double>& Cluster::gatherDimension(int d) const {
+    if(dimensionBuffer == NULL) {
+        dimensionBuffer = new vector<double>;
+        #pragma omp critical(TerranDimensionBuffers)
+        dimensionBuffers.buffers.push_back(dimensionBuffer);
+    }
+    vector<double> &data = *dimensionBuffer;
+    data.resize(subsample_.size());
+    if(rows_ != NULL) {
+        for(int i=0; i<subsample_.size(); i++) {
+            data[i] = (*dataset_)(rows_[subsample_[i]], d);
+        }
+    } else if(data.size() > 0) {
+        dataset_->gather(d, &subsample_[0], subsample_.size(), &data[0]);
     }
-    random_shuffle(data.begin(), data.end());
-    data.resize(subsampleCount_);
     return data;
 }
 
@@ -144,37 +327,119 @@ void Cluster::setPartition(int d, const vector<double> &p) {
     if(d > getNumDimensions() - 1) {
         throw(std::runtime_error("Dimension out of bounds\n"));
     }
+    for(int j=1; j < p.size(); j++) {
+        if(p[j] < p[j-1]) {
+            throw(std::runtime_error("Cluster::setPartition() - partition is not sorted"));
+        }
+    }
     partitions_[d] = p;
+    partitionFlag_[d] = true;
 }
 
 void Cluster::partition(int d) {
-	partitioner_->setDataAndPeriod(getDimension(d), period_[d]);
+	partitioner_->setDataAndPeriod(gatherDimension(d), isPeriodic(d));
+	partitioner_->setSeed(Random::derive(seed_, d+1));
 	partitions_[d] = partitioner_->partition();
+	iterations_ += partitioner_->getIterations();
 	partitionFlag_[d] = true;
 };
 
 
 void Cluster::partitionAll() {
-#ifdef _OPENMP
-	#pragma omp parallel for
-	for(int d=0; d < getNumDimensions(); d++) {
-		// partitioner_ acts like a factory in this case.
-		vector<double> data = getDimension(d);
-		bool period = period_[d];
-		Partitioner* np = partitioner_->clone(data, period);
-		vector<double> d_part = np->partition();      
-		#pragma omp critical 
-		{
-			partitionFlag_[d] = true;
-		    partitions_[d] = d_part;
+	vector<int> dims(getNumDimensions());
+	for(int d=0; d < dims.size(); d++) {
+		dims[d] = d;
+	}
+	partitionDimensions(dims);
+}
+
+// a periodic dimension needs two cuts to split the cluster
+bool Cluster::isSplit(int d) const {
+	return partitions_[d].size() >= (isPeriodic(d) ? 2 : 1);
+}
+
+// each wave asks for as many dimensions as there are splits missing, which
+// keeps the result independent of the number of threads
+void Cluster::partitionGreedy(int maxSplits) {
+	const int D = getNumDimensions();
+	if(maxSplits <= 0 || maxSplits >= D) {
+		partitionAll();
+		return;
+	}
+	// most multimodal first, ties go to the lower dimension
+	vector<pair<double, int> > order(D);
+	for(int d=0; d < D; d++) {
+		order[d] = make_pair(-multimodality(gatherDimension(d), isPeriodic(d)), d);
+	}
+	sort(order.begin(), order.end());
+
+	int next = 0;
+	int splits = 0;
+	while(splits < maxSplits && next < D) {
+		vector<int> wave;
+		while(wave.size() < maxSplits-splits && next < D) {
+			wave.push_back(order[next++].second);
+		}
+		partitionDimensions(wave);
+		for(int i=0; i < wave.size(); i++) {
+			if(isSplit(wave[i]))
+				splits++;
 		}
-		delete np; 
 	}
-#else
-	for(int d=0; d < getNumDimensions(); d++) {
-		partition(d);
+	// the children look at these dimensions again
+	for(; next < D; next++) {
+		setPartition(order[next].second, vector<double>());
 	}
+}
+
+void Cluster::partitionDimensions(const vector<int> &dims) {
+	// message of the exception raised by each dimension, if any
+	vector<string> errors(dims.size());
+	vector<int> iterations(dims.size(), 0);
+#ifdef _OPENMP
+	// join an enclosing parallel region instead of nesting a new one
+	if(omp_in_parallel()) {
+		partitionTasks(dims, errors, iterations);
+	} else {
+		#pragma omp parallel
+		#pragma omp single
+		partitionTasks(dims, errors, iterations);
+	}
+#else
+	partitionTasks(dims, errors, iterations);
 #endif
+	for(int i=0; i < dims.size(); i++) {
+		if(errors[i].empty())
+			partitionFlag_[dims[i]] = true;
+		iterations_ += iterations[i];
+	}
+	for(int i=0; i < dims.size(); i++) {
+		if(!errors[i].empty())
+			throw(std::runtime_error(errors[i]));
+	}
+}
+
+// spawns one task per dimension, the EM fit inside each one splits into tasks of
+// its own so that idle threads are used even when there are few dimensions
+void Cluster::partitionTasks(const vector<int> &dims, vector<string> &errors, vector<int> &iterations) {
+	for(int i=0; i < dims.size(); i++) {
+		#pragma omp task default(shared) firstprivate(i)
+		{
+			const int d = dims[i];
+			// partitioner_ acts like a factory in this case.
+			Partitioner* np = NULL;
+			try {
+				np = partitioner_->clone(gatherDimension(d), isPeriodic(d));
+				np->setSeed(Random::derive(seed_, d+1));
+				partitions_[d] = np->partition();
+				iterations[i] = np->getIterations();
+			} catch(const std::exception &e) {
+				errors[i] = e.what();
+			}
+			delete np;
+		}
+	}
+	#pragma omp taskwait
 }
 
 vector<int> Cluster::assign() {
@@ -185,19 +450,212 @@ vector<int> Cluster::assign() {
 			throw(std::runtime_error(errmsg.str()));
 		}
 	}
-    // assign each point to a bucket
+    const int N = getNumPoints();
+    const int D = getNumDimensions();
+
+    // number of buckets along each dimension, and of hypercubes overall
+    vector<unsigned long long> radix(D);
+    unsigned long long cells = 1;
+    for(int d=0; d < D; d++) {
+        const unsigned long long cuts = partitions_[d].size();
+        radix[d] = isPeriodic(d) ? max(cuts, 1ULL) : cuts+1;
+        if(cells > (~0ULL)/radix[d]) {
+            return assignByMap();
+        }
+        cells *= radix[d];
+    }
+
+    // encode each point's hypercube as a mixed-radix integer with dimension 0
+    // most significant, so numeric order matches the lexicographic order of
+    // the bucket tuples
+    vector<unsigned long long> codes(N);
+    vector<int> assignment(N);
+    const int blockSize = 512;
+    const int numBlocks = (N+blockSize-1)/blockSize;
+    const bool parallel = N >= parallelAssignCutoff;
+
+    #pragma omp parallel if(parallel)
+    {
+        double gathered[blockSize];
+        int buckets[blockSize];
+        #pragma omp for schedule(static)
+        for(int block = 0; block < numBlocks; block++) {
+            const int start = block*blockSize;
+            const int count = min(blockSize, N-start);
+            unsigned long long *c = &codes[start];
+            for(int i = 0; i < count; i++) {
+                c[i] = 0;
+            }
+            for(int d=0; d < D; d++) {
+                // read contiguous columns in place, gather everything else
+                const double *x = dataset_->getColumn(d);
+                if(rows_ != NULL) {
+                    dataset_->gather(d, rows_+start, count, gathered);
+                    x = gathered;
+                } else if(x == NULL) {
+                    dataset_->gather(d, start, count, gathered);
+                    x = gathered;
+                } else {
+                    x += start;
+                }
+                findBuckets(x, count, partitions_[d], isPeriodic(d), buckets);
+                const unsigned long long r = radix[d];
+                for(int i = 0; i < count; i++) {
+                    c[i] = c[i]*r+buckets[i];
+                }
+            }
+        }
+    }
+
+    // every thread handles one contiguous chunk of points, and the per-thread
+    // results are always merged in thread order so the numbering does not
+    // depend on the number of threads
+
+    if(cells <= (unsigned long long) max(N, 1 << 16)) {
+        // few enough hypercubes to count them directly. All threads mark one
+        // shared table; they only ever store 1, so the order of the stores
+        // does not matter
+        vector<char> seen(cells, 0);
+        vector<int> label(cells);
+        vector<int> firsts(maxThreads()+1, 0);
+        #pragma omp parallel if(parallel)
+        {
+            const int t = threadNum();
+            const int nt = numThreads();
+            const int begin = (long long) N*t/nt;
+            const int end = (long long) N*(t+1)/nt;
+            const unsigned long long cellBegin = cells*t/nt;
+            const unsigned long long cellEnd = cells*(t+1)/nt;
+            for(int n = begin; n < end; n++) {
+                #pragma omp atomic write
+                seen[codes[n]] = 1;
+            }
+            #pragma omp barrier
+            // number the occupied cells: count them in each chunk of cells,
+            // then offset every chunk by the counts before it
+            int occupied = 0;
+            for(unsigned long long c = cellBegin; c < cellEnd; c++) {
+                occupied += seen[c];
+            }
+            firsts[t+1] = occupied;
+            #pragma omp barrier
+            #pragma omp single
+            {
+                for(int u = 0; u < nt; u++) {
+                    firsts[u+1] += firsts[u];
+                }
+            }
+            int clusterIndex = firsts[t];
+            for(unsigned long long c = cellBegin; c < cellEnd; c++) {
+                label[c] = seen[c] ? clusterIndex++ : -1;
+            }
+            #pragma omp barrier
+            for(int n = begin; n < end; n++) {
+                assignment[n] = label[codes[n]];
+            }
+        }
+    } else {
+        // LSD radix sort of the codes, carrying the point indices along
+        const int digitBits = 11;
+        const int digits = 1 << digitBits;
+        int bits = 0;
+        while(bits < 64 && ((cells-1) >> bits) != 0) {
+            bits++;
+        }
+        vector<unsigned long long> keysA(N), keysB(N);
+        vector<int> orderA(N), orderB(N);
+        vector<int> histograms(maxThreads()*digits);
+        vector<int> firsts(maxThreads()+1);
+        #pragma omp parallel if(parallel)
+        {
+            const int t = threadNum();
+            const int nt = numThreads();
+            const int begin = (long long) N*t/nt;
+            const int end = (long long) N*(t+1)/nt;
+            for(int n = begin; n < end; n++) {
+                keysA[n] = codes[n];
+                orderA[n] = n;
+            }
+            unsigned long long *keys = &keysA[0];
+            unsigned long long *keysTmp = &keysB[0];
+            int *order = &orderA[0];
+            int *orderTmp = &orderB[0];
+            int *count = &histograms[t*digits];
+            for(int shift = 0; shift < bits; shift += digitBits) {
+                fill(count, count+digits, 0);
+                for(int n = begin; n < end; n++) {
+                    count[(keys[n] >> shift) & (digits-1)]++;
+                }
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    // digit-major, thread-minor offsets keep every pass stable
+                    int offset = 0;
+                    for(int digit = 0; digit < digits; digit++) {
+                        for(int u = 0; u < nt; u++) {
+                            int c = histograms[u*digits+digit];
+                            histograms[u*digits+digit] = offset;
+                            offset += c;
+                        }
+                    }
+                }
+                for(int n = begin; n < end; n++) {
+                    int dst = count[(keys[n] >> shift) & (digits-1)]++;
+                    keysTmp[dst] = keys[n];
+                    orderTmp[dst] = order[n];
+                }
+                #pragma omp barrier
+                swap(keys, keysTmp);
+                swap(order, orderTmp);
+            }
+            // number the distinct codes: count the first occurrences in each
+            // chunk, then offset every chunk by the counts before it
+            int firstCount = 0;
+            for(int i = begin; i < end; i++) {
+                if(i == 0 || keys[i] != keys[i-1])
+                    firstCount++;
+            }
+            firsts[t+1] = firstCount;
+            #pragma omp barrier
+            #pragma omp single
+            {
+                for(int u = 0; u < nt; u++) {
+                    firsts[u+1] += firsts[u];
+                }
+            }
+            int clusterIndex = firsts[t]-1;
+            for(int i = begin; i < end; i++) {
+                if(i == 0 || keys[i] != keys[i-1])
+                    clusterIndex++;
+                assignment[order[i]] = clusterIndex;
+            }
+        }
+    }
+    return assignment;
+}
+
+// fallback for partitions whose hypercubes do not fit in a 64 bit code
+vector<int> Cluster::assignByMap() const {
+    const int N = getNumPoints();
+    const int D = getNumDimensions();
     map<vector<short>, vector<int> > clusters;
-    for(int n = 0; n < getNumPoints(); n++) {
-        vector<short> bucket = findBucket(n);
+    vector<short> bucket(D);
+    for(int n = 0; n < N; n++) {
+        for(int d = 0; d < D; d++) {
+            double x = getValue(n, d);
+            int b;
+            findBuckets(&x, 1, partitions_[d], isPeriodic(d), &b);
+            bucket[d] = b;
+        }
         clusters[bucket].push_back(n);
     }
 
     // loop over the buckets and set to cluster
     int clusterIndex = 0;
-    vector<int> assignment(getNumPoints(),-1);
+    vector<int> assignment(N,-1);
     for(map<vector<short>, vector<int> >::const_iterator it = clusters.begin();
         it != clusters.end(); it++) {
-        vector<int> pointIndices = it->second;
+        const vector<int> &pointIndices = it->second;
         for(int j=0; j<pointIndices.size(); j++) {
             assignment[pointIndices[j]] = clusterIndex;
         }
@@ -206,26 +664,11 @@ vector<int> Cluster::assign() {
     return assignment;
 }
 
-vector<short> Cluster::findBucket(int pointIndex) const {
-    // the initialization to zero for each dimension in the bucket is important
-    // as it takes care of the case when no partitions exist for that dimension
-    vector<short> bucket(getNumDimensions(), 0);
-    vector<double> point = dataset_[pointIndex];
-
-    // for each dimension in the point
-    for(int d=0; d<getNumDimensions(); d++) {
-        for(int j=0; j<partitions_[d].size(); j++) {
-            if(point[d] < partitions_[d][j]) {
-                bucket[d] = j;
-                break;
-            }
-            if(isPeriodic(d))
-                bucket[d] = 0;
-            else
-                bucket[d] = j+1;
-        }
+void Cluster::findBuckets(const double* x, int count, const vector<double> &cuts, bool periodic, int* buckets) {
+    const double* first = cuts.empty() ? NULL : &cuts[0];
+    for(int i = 0; i < count; i++) {
+        buckets[i] = findBucket(x[i], first, cuts.size(), periodic);
     }
-    return bucket;
 }
 
 Partitioner& Cluster::getPartitioner() {
@@ -1,45 +1,153 @@
 #include "ClusterTree.h"
 #include "Cluster.h"
+#include "Random.h"
+#include "TreeFile.h"
+#include "Buckets.h"
 #include <iostream>
 #include <utility>
 #include <algorithm>
 #include <fstream>
 #include <stdexcept>
 #include <complex>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 using namespace Terran;
 
+static double wallTime() {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double) clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+// number of nodes a budgeted build divides at once
+static int waveSize() {
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
 ClusterTree::ClusterTree(const vector<vector<double> > &dataset, const vector<int> &period) : 
+	lastCalledFunction_(NONE),
+    dataset_(dataset, period),
+    leavesStale_(false),
+    currentCluster_(NULL),
+    currentNode_(0),
+    minSplitSize_(3000),
+    maxSplits_(0),
+    driftTolerance_(5) {
+    initialize();
+}
+
+ClusterTree::ClusterTree(const Dataset &dataset) : 
+	lastCalledFunction_(NONE),
     dataset_(dataset),
-    period_(period),
-    root_(NULL),
+    leavesStale_(false),
     currentCluster_(NULL),
-	lastCalledFunction_(NONE) {
+    currentNode_(0),
+    minSplitSize_(3000),
+    maxSplits_(0),
+    driftTolerance_(5) {
+    initialize();
+}
 
-	for(int i=0; i < period.size(); i++) {
-		if(period[i] != 1 && period[i] != 0) {
-			
-			throw(std::runtime_error("period must either be zero (false), or one (true)"));
-		}
-	}
+ClusterTree::ClusterTree(const Dataset &dataset, const string &filename) : 
+	lastCalledFunction_(NONE),
+    dataset_(dataset),
+    leavesStale_(false),
+    currentCluster_(NULL),
+    currentNode_(0),
+    minSplitSize_(3000),
+    maxSplits_(0),
+    driftTolerance_(5) {
+    load(filename);
+}
 
-    vector<int> points(dataset.size());
-    for(int i=0; i<points.size(); i++) {
-        points[i]=i;
+void ClusterTree::initialize() {
+    permutation_.resize(dataset_.getNumPoints());
+    for(int i=0; i<permutation_.size(); i++) {
+        permutation_[i]=i;
     }
-    root_ = new Node;
-    root_->indices = points;
-    queue_.push(root_);
+    labels_.assign(permutation_.size(), 0);
+    nodes_.resize(1);
+    Node &root = nodes_[0];
+    root.begin = 0;
+    root.end = permutation_.size();
+    // seeding from rand() keeps the tree reproducible under srand(). It is the
+    // only draw from rand(), every node derives its seed from this one.
+    root.seed = Random::seedFromRand();
+    leaves_.push_back(0);
+    queue_.push(0);
+}
+
+void ClusterTree::load(const string &filename) {
+    TreeFile file(filename);
+    const int D = getNumDimensions();
+    if(!file.hasPermutation())
+        throw(std::runtime_error("ClusterTree::load() - file has no permutation to resume from"));
+    if(file.getNumPoints() != getNumPoints() || file.getNumDimensions() != D)
+        throw(std::runtime_error("ClusterTree::load() - file does not match the dataset"));
+    for(int d=0; d < D; d++) {
+        if(file.isPeriodic(d) != dataset_.isPeriodic(d))
+            throw(std::runtime_error("ClusterTree::load() - periodicity does not match the dataset"));
+    }
+
+    const int* permutation = file.getPermutation();
+    permutation_.assign(permutation, permutation+getNumPoints());
+    labels_.assign(getNumPoints(), -1);
+    nodes_.resize(file.getNumNodes());
+    leaves_.assign(file.getNumClusters(), -1);
+    for(int i=0; i < nodes_.size(); i++) {
+        const TreeFileNode &record = file.getNode(i);
+        Node &node = nodes_[i];
+        node.begin = record.begin;
+        node.end = record.end;
+        node.firstChild = record.firstChild;
+        node.numChildren = record.numChildren;
+        node.seed = record.seed;
+        if(i > 0)
+            node.buckets.assign(file.getBuckets(i), file.getBuckets(i)+D);
+        if(node.numChildren > 0) {
+            node.partitions.resize(D);
+            for(int d=0; d < D; d++) {
+                int count;
+                const double* cuts = file.getCuts(i, d, count);
+                node.partitions[d].assign(cuts, cuts+count);
+            }
+        } else {
+            leaves_[record.leaf] = i;
+            for(int p=node.begin; p < node.end; p++) {
+                if(permutation_[p] < 0 || permutation_[p] >= getNumPoints())
+                    throw(std::runtime_error("ClusterTree::load() - bad permutation"));
+                labels_[permutation_[p]] = i;
+            }
+        }
+        if(record.flags & TreeFile::QUEUED)
+            queue_.push(i);
+    }
+    if(find(leaves_.begin(), leaves_.end(), -1) != leaves_.end())
+        throw(std::runtime_error("ClusterTree::load() - leaves are numbered twice"));
+    // the file is untrusted, every point must belong to exactly one leaf
+    validateData();
 }
 
 ClusterTree::~ClusterTree() {
-    delete root_;
 	delete currentCluster_;
 }
 
 int ClusterTree::getNumPoints() const {
-    return dataset_.size();
+    return dataset_.getNumPoints();
 }
 
 
@@ -60,7 +168,7 @@ vector<vector<double> > ClusterTree::centroid(int k) {
 
 	vector<vector<int> > groups(numClusters);
 
-	for(int i=0; i < dataset_.size(); i++) {
+	for(int i=0; i < dataset_.getNumPoints(); i++) {
 		groups[assignment[i]].push_back(i);
 	}
 	sort(groups.begin(), groups.end(), vvecSortByDescendingSize);
@@ -69,18 +177,18 @@ vector<vector<double> > ClusterTree::centroid(int k) {
 	vector<vector<double> > centroids(groups.size());
 
 	for(int i=0; i < groups.size(); i++) {
-		vector<double> center(period_.size());
+		vector<double> center(dataset_.getNumDimensions());
 		const vector<int> &points = groups[i];
 		// for each dimension
-		for(int d = 0; d < period_.size(); d++) {
+		for(int d = 0; d < dataset_.getNumDimensions(); d++) {
 			double mean = 0;
 			// if the dimension is periodic we use directional statistics
 			// to compute the periodic mean
-			if(period_[d]) {
+			if(dataset_.isPeriodic(d)) {
 				double real = 0;
 				double imag = 0;
 				for(int n = 0; n < points.size(); n++) {
-					double coord = dataset_[points[n]][d];
+					double coord = dataset_(points[n], d);
 					real += cos(coord);
 					imag += sin(coord);
 				}
@@ -88,7 +196,7 @@ vector<vector<double> > ClusterTree::centroid(int k) {
 				mean = arg(z);
 			} else {
 				for(int n = 0; n < points.size(); n++) {
-					double coord = dataset_[points[n]][d];
+					double coord = dataset_(points[n], d);
 					mean += coord;
 				}
 				mean = mean / points.size();
@@ -101,45 +209,69 @@ vector<vector<double> > ClusterTree::centroid(int k) {
 }
 */
 
-// traverse down the to the leaves
+// cluster i is leaf i, labels_ already holds the leaf of every point
 vector<int> ClusterTree::assign() const {
 
-    vector<vector<int> > clusters;
-    vector<const Node*> leaves = getLeaves();
+#ifndef NDEBUG
+    validateData();
+#endif
 
+    const vector<int> &leaves = getLeaves();
+    vector<int> cluster(nodes_.size(), -1);
     for(int i=0; i < leaves.size(); i++) {
-        clusters.push_back(leaves[i]->indices);
+        cluster[leaves[i]] = i;
     }
-    // check that all points exist
-    vector<int> allPoints;
-    for(int i=0; i < clusters.size(); i++) {
-        allPoints.insert(allPoints.end(),clusters[i].begin(),  clusters[i].end());
-    }
-    if(allPoints.size() != getNumPoints()) {
-        throw(std::runtime_error("Wrong number of points!"));
+    vector<int> assignment(getNumPoints());
+    for(int n=0; n < assignment.size(); n++) {
+        assignment[n] = cluster[labels_[n]];
     }
-    sort(allPoints.begin(), allPoints.end());
+    
+    return assignment;
+}
 
-    for(int i=1; i < allPoints.size(); i++) {
-        if(allPoints[i] != allPoints[i-1]+1) {
-            throw(std::runtime_error("Bad point found!"));
+void ClusterTree::validateData() const {
+    vector<char> seen(getNumPoints(), 0);
+    int total = 0;
+    const vector<int> &leaves = getLeaves();
+    for(int i=0; i < leaves.size(); i++) {
+        const Node &leaf = nodes_[leaves[i]];
+        const int count = leaf.end-leaf.begin;
+        for(int j=0; j < count+leaf.pending.size(); j++) {
+            const int n = j < count ? permutation_[leaf.begin+j] : leaf.pending[j-count];
+            if(n < 0 || n >= seen.size() || seen[n]) {
+                throw(std::runtime_error("Bad point found!"));
+            }
+            if(labels_[n] != leaves[i]) {
+                throw(std::runtime_error("ClusterTree::validateData() - point has the wrong label"));
+            }
+            seen[n] = 1;
         }
+        total += count+leaf.pending.size();
     }
-
-    vector<int> assignment(getNumPoints());
-    for(int i=0; i<clusters.size(); i++) {
-        for(int j=0; j < clusters[i].size(); j++) {
-            assignment[clusters[i][j]] = i;
-        }
+    if(total != getNumPoints()) {
+        throw(std::runtime_error("Wrong number of points!"));
     }
-    
-    return assignment;
 }
 
 int ClusterTree::getNumClusters() const {
     return getLeaves().size();
 }
 
+// only divideCurrentCluster() leaves the list stale. Its children come after
+// every other node, so the leaves in index order are the list it would have
+// kept by replacing the divided node with its children.
+const vector<int>& ClusterTree::getLeaves() const {
+    if(leavesStale_) {
+        leaves_.resize(0);
+        for(int i=0; i < nodes_.size(); i++) {
+            if(nodes_[i].numChildren == 0)
+                leaves_.push_back(i);
+        }
+        leavesStale_ = false;
+    }
+    return leaves_;
+}
+
 // setCurrentCluster must be called exactly once. 
 
 void ClusterTree::setCurrentCluster(Partitioner* partitioner) {
@@ -152,24 +284,23 @@ void ClusterTree::setCurrentCluster(Partitioner* partitioner) {
         if(currentCluster_ != NULL)
             throw(std::runtime_error("ClusterTree::currentCluster_ is not set to NULL, has divideCluster() been called?"));
         currentNode_ = queue_.front();
+        layout(currentNode_);
+        const Node &node = nodes_[currentNode_];
     
-        if(currentNode_->indices.size() == 0) 
+        if(node.end == node.begin) 
             throw(std::runtime_error("ClusterTree::step() - currentNode_ has no points"));
-        if(currentNode_->partitions.size() > 0)
+        if(node.partitions.size() > 0)
             throw(std::runtime_error("ClusterTree::step() - currentNode_ partition not empty"));
-        if(currentNode_->children.size() > 0)
+        if(node.numChildren > 0)
             throw(std::runtime_error("ClusterTree::step() - currentNode_ children not empty"));
     
-        vector<vector<double> > subset;
-        const vector<int> &indices = currentNode_->indices;
-        for(int i=0; i<indices.size(); i++) {
-            subset.push_back(dataset_[indices[i]]);
-        }
-
+        // the cluster is a view over the node's rows, no points are copied
+        const int* rows = &permutation_[node.begin];
+        const int count = node.end - node.begin;
         if(partitioner != NULL) 
-            currentCluster_ = new Cluster(subset, period_, partitioner);
+            currentCluster_ = new Cluster(dataset_, rows, count, partitioner, node.seed);
         else
-            currentCluster_ = new Cluster(subset, period_);
+            currentCluster_ = new Cluster(dataset_, rows, count, node.seed);
         
     }
 
@@ -177,38 +308,116 @@ void ClusterTree::setCurrentCluster(Partitioner* partitioner) {
 
 }
 
-int ClusterTree::queueSize() const {
-	return queue_.size();
-}
-
-void ClusterTree::divideCurrentCluster(int count) {
-
-	if(lastCalledFunction_ == DIVIDE_CURRENT_CLUSTER) {
-		throw(std::runtime_error("ClusterTree::setCurrentCluster - called divideCurrenCluster twice"));
-	}
+// the points are moved with a stable counting sort on their new cluster, so
+// within each child they keep the order they had in the parent. nodes_ may be
+// reallocated by other threads, so it is only touched inside the critical
+// section; the node's range of permutation_ belongs to this call alone.
+void ClusterTree::divideNode(int id, Cluster &cluster, int count, vector<int> &ready) {
+    int begin;
+    int end;
+    unsigned long long seed;
+    getRange(id, begin, end, seed);
 
 	// get assignment of points from current cluster
-    vector<int> assignment = currentCluster_->assign();
+    vector<int> assignment = cluster.assign();
     int maxAssignmentId = *(max_element(assignment.begin(), assignment.end()));
-    const vector<int> &indices = currentNode_->indices;
     if(maxAssignmentId > 0) {
-        vector<vector<int> > subsetIndices(maxAssignmentId+1);
+        const int numChildren = maxAssignmentId+1;
+        vector<int> start(numChildren+1, 0);
+        for(int j=0; j < assignment.size(); j++) {
+            start[assignment[j]+1]++;
+        }
+        for(int k=0; k < numChildren; k++) {
+            start[k+1] += start[k];
+        }
+        int* rows = &permutation_[begin];
+        vector<int> next(start.begin(), start.end()-1);
+        vector<int> sorted(assignment.size());
         for(int j=0; j < assignment.size(); j++) {
-            subsetIndices[assignment[j]].push_back(indices[j]);
+            sorted[next[assignment[j]]++] = rows[j];
         }
-        // for each new cluster
-        for(int j=0; j < subsetIndices.size(); j++) {
-            Node* newNode = new Node;
-            newNode->indices = subsetIndices[j];
-            currentNode_->children.push_back(newNode);
-			
+        copy(sorted.begin(), sorted.end(), rows);
+
+        // the new clusters are stored next to each other, each keeps the
+        // buckets of its first point so that new points can be routed to it
+        const int D = cluster.getNumDimensions();
+        vector<vector<double> > partitions(D);
+        for(int d=0; d < D; d++) {
+            partitions[d] = cluster.getPartition(d);
+        }
+        vector<Node> children(numChildren);
+        for(int k=0; k < numChildren; k++) {
+            children[k].begin = begin+start[k];
+            children[k].end = begin+start[k+1];
+            children[k].seed = Random::derive(seed, k);
+            children[k].buckets.resize(D);
+            for(int d=0; d < D; d++) {
+                const double x = dataset_(rows[start[k]], d);
+                Cluster::findBuckets(&x, 1, partitions[d], dataset_.isPeriodic(d), &children[k].buckets[d]);
+            }
+            // children that stay leaves keep the features of their points for
+            // insert(), gathered while their rows are at hand
+            if(start[k+1]-start[k] <= count) {
+                for(int j=start[k]; j < start[k+1]; j++) {
+                    addMoments(children[k].reference, rows[j]);
+                }
+            }
+        }
+        int firstChild;
+        #pragma omp critical(TerranClusterTreeNodes)
+        {
+            firstChild = nodes_.size();
+            nodes_.insert(nodes_.end(), children.begin(), children.end());
+            nodes_[id].firstChild = firstChild;
+            nodes_[id].numChildren = numChildren;
+            nodes_[id].partitions.swap(partitions);
+        }
+
+        for(int k=0; k < numChildren; k++) {
+            for(int p=begin+start[k]; p < begin+start[k+1]; p++) {
+                labels_[permutation_[p]] = firstChild+k;
+            }
 			// add this new cluster to the todo list if it has more than 3500 points.
 			// (if there are less than 3500 points its hard to marginalize)
-			if(subsetIndices[j].size() > count) {
-				queue_.push(newNode);
+			if(start[k+1]-start[k] > count) {
+				ready.push_back(firstChild+k);
 			}
         }
+    } else {
+        // the node stays a leaf. Unless layout() carried its features forward
+        // they are gathered here, at a cost below that of assign()
+        bool complete;
+        #pragma omp critical(TerranClusterTreeNodes)
+        complete = nodes_[id].reference.count == end-begin;
+        if(!complete) {
+            Moments reference;
+            for(int p=begin; p < end; p++) {
+                addMoments(reference, permutation_[p]);
+            }
+            #pragma omp critical(TerranClusterTreeNodes)
+            nodes_[id].reference = reference;
+        }
+    }
+}
+
+int ClusterTree::queueSize() const {
+	return queue_.size();
+}
+
+void ClusterTree::divideCurrentCluster(int count) {
+
+	if(lastCalledFunction_ == DIVIDE_CURRENT_CLUSTER) {
+		throw(std::runtime_error("ClusterTree::setCurrentCluster - called divideCurrenCluster twice"));
+	}
+
+    vector<int> ready;
+    divideNode(currentNode_, *currentCluster_, count, ready);
+    for(int j=0; j < ready.size(); j++) {
+        queue_.push(ready[j]);
     }
+    // finding the node in leaves_ would make a run of steps quadratic
+    if(nodes_[currentNode_].numChildren > 0)
+        leavesStale_ = true;
     delete currentCluster_;
     currentCluster_ = NULL;
 	// pop the queue
@@ -218,39 +427,657 @@ void ClusterTree::divideCurrentCluster(int count) {
 
 }
 
-std::vector<const ClusterTree::Node*> ClusterTree::getLeaves() const {
-    queue<const Node*> bfsQueue;
-    bfsQueue.push(root_);
-    vector<const Node*> leaves;
-    while(bfsQueue.size() != 0) {
-        const Node* current = bfsQueue.front();
-        bfsQueue.pop();
+bool ClusterTree::build(const Budget &budget) {
+
+	if(lastCalledFunction_ == SET_CURRENT_CLUSTER) {
+		throw(std::runtime_error("ClusterTree::build() - divideCurrentCluster() has not been called"));
+	}
+
+    vector<int> nodes;
+    while(queue_.size() > 0) {
+        nodes.push_back(queue_.front());
+        layout(queue_.front());
+        queue_.pop();
+    }
+
+    // message of the first exception raised by any node
+    string error;
+#ifdef _OPENMP
+	// join an enclosing parallel region instead of nesting a new one
+	if(omp_in_parallel()) {
+		buildNodes(nodes, budget, &error);
+	} else {
+		#pragma omp parallel
+		#pragma omp single
+		buildNodes(nodes, budget, &error);
+	}
+#else
+	buildNodes(nodes, budget, &error);
+#endif
+
+    for(int i=0; i < nodes.size(); i++) {
+        queue_.push(nodes[i]);
+    }
+    // the nodes were created in whatever order the tasks ran
+    renumber();
+
+	lastCalledFunction_ = DIVIDE_CURRENT_CLUSTER;
+
+    if(!error.empty())
+        throw(std::runtime_error(error));
+
+    return queue_.size() == 0;
+}
+
+void ClusterTree::buildNodes(vector<int> &nodes, const Budget &budget, string* error) {
+    if(budget.seconds > 0 || budget.nodes > 0 || budget.iterations > 0) {
+        buildWaves(nodes, budget, error);
+    } else {
+        buildTasks(nodes, minSplitSize_, error);
+        nodes.resize(0);
+    }
+}
+
+void ClusterTree::buildTasks(const vector<int> &nodes, int count, string* error) {
+	#pragma omp taskgroup
+	{
+		for(int i=0; i < nodes.size(); i++) {
+			int id = nodes[i];
+			#pragma omp task default(shared) firstprivate(id, count, error)
+			buildNode(id, count, error);
+		}
+	}
+}
+
+// each node only writes to itself, its new children and its own range of
+// permutation_, so nodes can be processed in any order
+void ClusterTree::buildNode(int id, int count, string* error) {
+    vector<int> ready;
+    splitNode(id, count, ready, error);
+    for(int j=0; j < ready.size(); j++) {
+        int child = ready[j];
+        #pragma omp task default(shared) firstprivate(child, count, error)
+        buildNode(child, count, error);
+    }
+}
+
+// the frontier is a max heap on priority, ties go to the node created first.
+// At most one wave runs past the time and iteration budgets.
+void ClusterTree::buildWaves(vector<int> &nodes, const Budget &budget, string* error) {
+    const double start = wallTime();
+    priority_queue<pair<double, int> > frontier;
+    for(int i=0; i < nodes.size(); i++) {
+        frontier.push(make_pair(getPriority(nodes[i], budget.priority), -nodes[i]));
+    }
+    int processed = 0;
+    long long spent = 0;
+    while(frontier.size() > 0) {
+        if(budget.seconds > 0 && wallTime()-start >= budget.seconds)
+            break;
+        if(budget.nodes > 0 && processed >= budget.nodes)
+            break;
+        if(budget.iterations > 0 && spent >= budget.iterations)
+            break;
+
+        int size = waveSize();
+        if(budget.nodes > 0)
+            size = min(size, budget.nodes-processed);
+        vector<int> wave;
+        while(wave.size() < size && frontier.size() > 0) {
+            wave.push_back(-frontier.top().second);
+            frontier.pop();
+        }
+
+        vector<vector<int> > ready(wave.size());
+        vector<vector<double> > priorities(wave.size());
+        vector<long long> iterations(wave.size(), 0);
+        #pragma omp taskgroup
+        {
+            for(int i=0; i < wave.size(); i++) {
+                #pragma omp task default(shared) firstprivate(i)
+                {
+                    iterations[i] = splitNode(wave[i], minSplitSize_, ready[i], error);
+                    for(int j=0; j < ready[i].size(); j++) {
+                        priorities[i].push_back(getPriority(ready[i][j], budget.priority));
+                    }
+                }
+            }
+        }
+
+        processed += wave.size();
+        for(int i=0; i < wave.size(); i++) {
+            spent += iterations[i];
+            for(int j=0; j < ready[i].size(); j++) {
+                frontier.push(make_pair(priorities[i][j], -ready[i][j]));
+            }
+        }
+    }
+
+    nodes.resize(0);
+    while(frontier.size() > 0) {
+        nodes.push_back(-frontier.top().second);
+        frontier.pop();
+    }
+}
+
+long long ClusterTree::splitNode(int id, int count, vector<int> &ready, string* error) {
+    long long iterations = 0;
+    try {
+        int begin;
+        int end;
+        unsigned long long seed;
+        getRange(id, begin, end, seed);
+        Cluster cluster(dataset_, &permutation_[begin], end - begin, seed);
+        cluster.partitionGreedy(maxSplits_);
+        iterations = cluster.getIterations();
+        divideNode(id, cluster, count, ready);
+    } catch(const std::exception &e) {
+        #pragma omp critical(TerranClusterTreeBuild)
+        {
+            if(error->empty())
+                *error = e.what();
+        }
+    }
+    return iterations;
+}
 
-        if(current->children.size() == 0) {
-            leaves.push_back(current);
+// the variance is summed over the dimensions, periodic dimensions use the
+// circular variance 2(1-R) which matches the variance of narrow distributions
+double ClusterTree::getPriority(int id, Priority priority) const {
+    int begin;
+    int end;
+    unsigned long long seed;
+    getRange(id, begin, end, seed);
+    const int count = end-begin;
+    if(priority == LARGEST_FIRST || count == 0)
+        return count;
+    double total = 0;
+    for(int d=0; d < getNumDimensions(); d++) {
+        if(dataset_.isPeriodic(d)) {
+            double c = 0;
+            double s = 0;
+            for(int p=begin; p < end; p++) {
+                const double x = dataset_(permutation_[p], d);
+                c += cos(x);
+                s += sin(x);
+            }
+            total += 2*(1-sqrt(c*c+s*s)/count);
         } else {
-            for(int i=0; i<current->children.size(); i++) {
-                const Node* child = current->children[i];
-                bfsQueue.push(child);
+            double mean = 0;
+            for(int p=begin; p < end; p++) {
+                mean += dataset_(permutation_[p], d);
+            }
+            mean /= count;
+            double variance = 0;
+            for(int p=begin; p < end; p++) {
+                const double x = dataset_(permutation_[p], d)-mean;
+                variance += x*x;
+            }
+            total += variance/count;
+        }
+    }
+    return total;
+}
+
+void ClusterTree::getRange(int id, int &begin, int &end, unsigned long long &seed) const {
+    #pragma omp critical(TerranClusterTreeNodes)
+    {
+        begin = nodes_[id].begin;
+        end = nodes_[id].end;
+        seed = nodes_[id].seed;
+    }
+}
+
+// the children of a node are adjacent in BFS order as well, so only the node
+// indices change
+void ClusterTree::renumber() {
+    vector<Node> sorted;
+    sorted.reserve(nodes_.size());
+    sorted.push_back(nodes_[0]);
+    vector<int> newIndex(nodes_.size());
+    newIndex[0] = 0;
+    leaves_.resize(0);
+    leavesStale_ = false;
+    for(int i=0; i < sorted.size(); i++) {
+        Node &node = sorted[i];
+        if(node.numChildren == 0) {
+            leaves_.push_back(i);
+            continue;
+        }
+        const int firstChild = node.firstChild;
+        node.firstChild = sorted.size();
+        for(int k=0; k < node.numChildren; k++) {
+            newIndex[firstChild+k] = sorted.size();
+            sorted.push_back(nodes_[firstChild+k]);
+        }
+    }
+    nodes_.swap(sorted);
+    for(int n=0; n < labels_.size(); n++) {
+        labels_[n] = newIndex[labels_[n]];
+    }
+    // queued nodes are processed in BFS order
+    vector<int> queued;
+    while(queue_.size() > 0) {
+        queued.push_back(newIndex[queue_.front()]);
+        queue_.pop();
+    }
+    sort(queued.begin(), queued.end());
+    for(int i=0; i < queued.size(); i++) {
+        queue_.push(queued[i]);
+    }
+}
+
+int ClusterTree::insert(const vector<vector<double> > &points) {
+
+	if(lastCalledFunction_ == SET_CURRENT_CLUSTER) {
+		throw(std::runtime_error("ClusterTree::insert() - divideCurrentCluster() has not been called"));
+	}
+
+    const int first = getNumPoints();
+    dataset_.append(points);
+    labels_.resize(getNumPoints());
+    vector<int> buckets(getNumDimensions());
+    vector<char> seen(nodes_.size(), 0);
+    vector<int> touched;
+    for(int n=first; n < getNumPoints(); n++) {
+        const int id = route(n, buckets);
+        Node &node = nodes_[id];
+        if(!seen[id])
+            touched.push_back(id);
+        seen[id] = 1;
+        node.pending.push_back(n);
+        addMoments(node.inserted, n);
+        labels_[n] = id;
+    }
+
+    // queued leaves are divided by the next build() or step() anyway
+    vector<char> queued(nodes_.size(), 0);
+    queue<int> pending(queue_);
+    while(pending.size() > 0) {
+        queued[pending.front()] = 1;
+        pending.pop();
+    }
+    vector<int> nodes;
+    for(int i=0; i < touched.size(); i++) {
+        const int id = touched[i];
+        const Node &node = nodes_[id];
+        const int count = node.end-node.begin;
+        if(queued[id] || count+node.pending.size() <= minSplitSize_)
+            continue;
+        if(count <= minSplitSize_ || hasDrifted(id))
+            nodes.push_back(id);
+    }
+    if(nodes.size() == 0)
+        return 0;
+
+    for(int i=0; i < nodes.size(); i++) {
+        layout(nodes[i]);
+    }
+    string error;
+#ifdef _OPENMP
+	if(omp_in_parallel()) {
+		buildTasks(nodes, minSplitSize_, &error);
+	} else {
+		#pragma omp parallel
+		#pragma omp single
+		buildTasks(nodes, minSplitSize_, &error);
+	}
+#else
+	buildTasks(nodes, minSplitSize_, &error);
+#endif
+    renumber();
+
+    if(!error.empty())
+        throw(std::runtime_error(error));
+
+    return nodes.size();
+}
+
+int ClusterTree::route(int n, vector<int> &buckets) const {
+    const int D = getNumDimensions();
+    int id = 0;
+    while(nodes_[id].numChildren > 0) {
+        const Node &node = nodes_[id];
+        for(int d=0; d < D; d++) {
+            const double x = dataset_(n, d);
+            Cluster::findBuckets(&x, 1, node.partitions[d], dataset_.isPeriodic(d), &buckets[d]);
+        }
+        // the child covering the cell, or the one nearest to it
+        int best = node.firstChild;
+        int bestDistance = -1;
+        for(int k=0; k < node.numChildren && bestDistance != 0; k++) {
+            const vector<int> &other = nodes_[node.firstChild+k].buckets;
+            int distance = 0;
+            for(int d=0; d < D; d++) {
+                distance += bucketDistance(other[d], buckets[d], node.partitions[d].size(), dataset_.isPeriodic(d));
             }
+            if(bestDistance < 0 || distance < bestDistance) {
+                best = node.firstChild+k;
+                bestDistance = distance;
+            }
+        }
+        id = best;
+    }
+    return id;
+}
+
+void ClusterTree::addMoments(Moments &moments, int n) const {
+    const int D = getNumDimensions();
+    double features[4];
+    if(moments.count == 0) {
+        int count = 0;
+        for(int d=0; d < D; d++) {
+            count += dataset_.isPeriodic(d) ? 4 : 2;
         }
+        moments.sum.assign(count, 0);
+        moments.sumSquares.assign(count, 0);
     }
-    return leaves;
+    int f = 0;
+    for(int d=0; d < D; d++) {
+        const double x = dataset_(n, d);
+        int count = 2;
+        if(dataset_.isPeriodic(d)) {
+            features[0] = cos(x);
+            features[1] = sin(x);
+            features[2] = cos(2*x);
+            features[3] = sin(2*x);
+            count = 4;
+        } else {
+            features[0] = x;
+            features[1] = x*x;
+        }
+        for(int j=0; j < count; j++, f++) {
+            moments.sum[f] += features[j];
+            moments.sumSquares[f] += features[j]*features[j];
+        }
+    }
+    moments.count++;
+}
+
+void ClusterTree::addMoments(Moments &moments, const Moments &other) const {
+    if(other.count == 0)
+        return;
+    if(moments.count == 0) {
+        moments = other;
+        return;
+    }
+    for(int f=0; f < moments.sum.size(); f++) {
+        moments.sum[f] += other.sum[f];
+        moments.sumSquares[f] += other.sumSquares[f];
+    }
+    moments.count += other.count;
+}
+
+// Welch's test on the mean of every feature. The features of the range were
+// gathered when the leaf was made, only leaves of a tree that was loaded from
+// a file need to scan their range once.
+bool ClusterTree::hasDrifted(int id) {
+    Node &node = nodes_[id];
+    if(node.reference.count == 0) {
+        for(int p=node.begin; p < node.end; p++) {
+            addMoments(node.reference, permutation_[p]);
+        }
+    }
+    const Moments &before = node.reference;
+    const Moments &after = node.inserted;
+    for(int f=0; f < before.sum.size(); f++) {
+        const double mean = before.sum[f]/before.count;
+        const double variance = max(before.sumSquares[f]/before.count-mean*mean, 0.0);
+        const double newMean = after.sum[f]/after.count;
+        const double newVariance = max(after.sumSquares[f]/after.count-newMean*newMean, 0.0);
+        const double error = sqrt(variance/before.count+newVariance/after.count);
+        if(fabs(newMean-mean) > driftTolerance_*error)
+            return true;
+    }
+    return false;
+}
+
+void ClusterTree::layout(int id) {
+    Node &node = nodes_[id];
+    if(node.pending.empty())
+        return;
+    vector<int> rows(permutation_.begin()+node.begin, permutation_.begin()+node.end);
+    rows.insert(rows.end(), node.pending.begin(), node.pending.end());
+    node.begin = permutation_.size();
+    permutation_.insert(permutation_.end(), rows.begin(), rows.end());
+    node.end = permutation_.size();
+    node.pending.clear();
+    // the range now holds the pending points as well
+    if(node.reference.count > 0)
+        addMoments(node.reference, node.inserted);
+    node.inserted = Moments();
+    // every point moved leaves a slot behind, so compacting when half the
+    // slots are unused costs O(1) per moved point
+    if(permutation_.size() > 2*getNumPoints())
+        compact();
+}
+
+void ClusterTree::flatten(int id, bool pending, vector<int> &permutation, vector<int> &ranges) const {
+    const Node &node = nodes_[id];
+    ranges[2*id] = permutation.size();
+    if(node.numChildren == 0) {
+        permutation.insert(permutation.end(), permutation_.begin()+node.begin, permutation_.begin()+node.end);
+        if(pending)
+            permutation.insert(permutation.end(), node.pending.begin(), node.pending.end());
+    } else {
+        for(int k=0; k < node.numChildren; k++) {
+            flatten(node.firstChild+k, pending, permutation, ranges);
+        }
+    }
+    ranges[2*id+1] = permutation.size();
+}
+
+void ClusterTree::compact() {
+    vector<int> permutation;
+    vector<int> ranges(2*nodes_.size());
+    permutation.reserve(getNumPoints());
+    flatten(0, false, permutation, ranges);
+    permutation_.swap(permutation);
+    for(int i=0; i < nodes_.size(); i++) {
+        nodes_[i].begin = ranges[2*i];
+        nodes_[i].end = ranges[2*i+1];
+    }
+}
+
+void ClusterTree::setDriftTolerance(double sigmas) {
+    if(sigmas <= 0)
+        throw(std::runtime_error("ClusterTree::setDriftTolerance() - sigmas must be positive"));
+    driftTolerance_ = sigmas;
+}
+
+double ClusterTree::getDriftTolerance() const {
+    return driftTolerance_;
+}
+
+// rounds a file offset up to the 8 byte alignment of every section
+static unsigned long long align(unsigned long long offset) {
+    return (offset+7) & ~7ULL;
+}
+
+template<typename T>
+static void writeSection(ofstream &out, unsigned long long offset, const T* data, size_t count) {
+    const unsigned long long position = out.tellp();
+    const char zeros[8] = {0};
+    out.write(zeros, offset-position);
+    if(count > 0)
+        out.write((const char*) data, count*sizeof(T));
+}
+
+void ClusterTree::save(const string &filename, bool permutation) const {
+    const int D = getNumDimensions();
+    vector<int> queued(nodes_.size(), 0);
+    queue<int> pending(queue_);
+    while(pending.size() > 0) {
+        queued[pending.front()] = 1;
+        pending.pop();
+    }
+    const vector<int> &leaves = getLeaves();
+    vector<int> leaf(nodes_.size(), -1);
+    for(int i=0; i < leaves.size(); i++) {
+        leaf[leaves[i]] = i;
+    }
+    // inserted points are stored as part of their leaves
+    vector<int> flat;
+    vector<int> ranges(2*nodes_.size());
+    flat.reserve(getNumPoints());
+    flatten(0, true, flat, ranges);
+
+    vector<TreeFileNode> records(nodes_.size());
+    vector<unsigned long long> cutStarts(1, 0);
+    vector<double> cuts;
+    vector<int> buckets(nodes_.size()*D, 0);
+    for(int i=0; i < nodes_.size(); i++) {
+        const Node &node = nodes_[i];
+        TreeFileNode &record = records[i];
+        record.begin = ranges[2*i];
+        record.end = ranges[2*i+1];
+        record.firstChild = node.firstChild;
+        record.numChildren = node.numChildren;
+        record.leaf = leaf[i];
+        record.flags = queued[i] ? TreeFile::QUEUED : 0;
+        record.seed = node.seed;
+        for(int d=0; d < D; d++) {
+            if(node.numChildren > 0 && d < node.partitions.size())
+                cuts.insert(cuts.end(), node.partitions[d].begin(), node.partitions[d].end());
+            cutStarts.push_back(cuts.size());
+            if(d < node.buckets.size())
+                buckets[i*D+d] = node.buckets[d];
+        }
+    }
+    const vector<int> &period = dataset_.getPeriod();
+
+    TreeFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "TRRN", 4);
+    header.byteOrder = 0x01020304;
+    header.version = TreeFile::VERSION;
+    header.numDimensions = D;
+    header.numNodes = nodes_.size();
+    header.flags = permutation ? TreeFile::HAS_PERMUTATION : 0;
+    header.numPoints = getNumPoints();
+    header.numCuts = cuts.size();
+    header.periodOffset = align(sizeof(header));
+    header.nodesOffset = align(header.periodOffset+D*sizeof(int));
+    header.cutStartsOffset = align(header.nodesOffset+records.size()*sizeof(TreeFileNode));
+    header.cutsOffset = align(header.cutStartsOffset+cutStarts.size()*sizeof(unsigned long long));
+    header.bucketsOffset = align(header.cutsOffset+cuts.size()*sizeof(double));
+    header.permutationOffset = permutation ? align(header.bucketsOffset+buckets.size()*sizeof(int)) : 0;
+
+    ofstream out(filename.c_str(), ios::binary | ios::trunc);
+    if(!out)
+        throw(std::runtime_error("ClusterTree::save() - cannot open " + filename));
+    out.write((const char*) &header, sizeof(header));
+    writeSection(out, header.periodOffset, &period[0], period.size());
+    writeSection(out, header.nodesOffset, &records[0], records.size());
+    writeSection(out, header.cutStartsOffset, &cutStarts[0], cutStarts.size());
+    writeSection(out, header.cutsOffset, cuts.empty() ? NULL : &cuts[0], cuts.size());
+    writeSection(out, header.bucketsOffset, buckets.empty() ? NULL : &buckets[0], buckets.size());
+    if(permutation)
+        writeSection(out, header.permutationOffset, flat.empty() ? NULL : &flat[0], flat.size());
+    out.close();
+    if(!out)
+        throw(std::runtime_error("ClusterTree::save() - cannot write " + filename));
+}
+
+// nodes with more cells than this are searched instead of tabulated
+static const int MAX_TABLE_SIZE = 4096;
+
+CompiledTree ClusterTree::compile() const {
+    const int D = getNumDimensions();
+    CompiledTree tree;
+    tree.numDimensions_ = D;
+    const vector<int> &leaves = getLeaves();
+    tree.numClusters_ = leaves.size();
+    tree.period_.assign(dataset_.getPeriod().begin(), dataset_.getPeriod().end());
+    tree.nodes_.resize(nodes_.size());
+    tree.cutStarts_.push_back(0);
+    tree.strides_.assign(nodes_.size()*D, 0);
+    tree.buckets_.assign(nodes_.size()*D, 0);
+    for(int i=0; i < leaves.size(); i++) {
+        tree.nodes_[leaves[i]].leaf = i;
+    }
+    for(int i=0; i < nodes_.size(); i++) {
+        const Node &node = nodes_[i];
+        CompiledTree::Node &compiled = tree.nodes_[i];
+        if(node.numChildren > 0)
+            compiled.leaf = -1;
+        compiled.firstChild = node.firstChild;
+        compiled.numChildren = node.numChildren;
+        compiled.table = -1;
+        // the number of cells is the product of the buckets of each dimension
+        double cells = 1;
+        for(int d=0; d < D; d++) {
+            const vector<double> empty;
+            const vector<double> &cuts = node.numChildren > 0 ? node.partitions[d] : empty;
+            tree.cuts_.insert(tree.cuts_.end(), cuts.begin(), cuts.end());
+            tree.cutStarts_.push_back(tree.cuts_.size());
+            if(i > 0)
+                tree.buckets_[i*D+d] = node.buckets[d];
+            cells *= dataset_.isPeriodic(d) ? max<int>(cuts.size(), 1) : cuts.size()+1;
+        }
+        if(node.numChildren > 0 && cells <= MAX_TABLE_SIZE) {
+            int stride = 1;
+            vector<int> radix(D);
+            for(int d=D-1; d >= 0; d--) {
+                tree.strides_[i*D+d] = stride;
+                const int count = node.partitions[d].size();
+                radix[d] = dataset_.isPeriodic(d) ? max(count, 1) : count+1;
+                stride *= radix[d];
+            }
+            // every cell, empty or not, holds the child nearest to it
+            compiled.table = tree.tables_.size();
+            tree.tables_.resize(tree.tables_.size()+stride);
+            for(int code=0; code < stride; code++) {
+                int best = node.firstChild;
+                int bestDistance = -1;
+                for(int k=0; k < node.numChildren && bestDistance != 0; k++) {
+                    const Node &child = nodes_[node.firstChild+k];
+                    int distance = 0;
+                    for(int d=0; d < D; d++) {
+                        const int bucket = code/tree.strides_[i*D+d] % radix[d];
+                        distance += bucketDistance(child.buckets[d], bucket, node.partitions[d].size(), dataset_.isPeriodic(d));
+                    }
+                    if(bestDistance < 0 || distance < bestDistance) {
+                        best = node.firstChild+k;
+                        bestDistance = distance;
+                    }
+                }
+                tree.tables_[compiled.table+code] = best;
+            }
+        }
+    }
+    return tree;
 }
 
 void ClusterTree::step() {
     setCurrentCluster();
     if(queue_.size() == 0) 
         return;
-	for(int d=0; d < getNumDimensions(); d++) {
-		currentCluster_->partition(d);
-	}
-	divideCurrentCluster(3000);
+	currentCluster_->partitionGreedy(maxSplits_);
+	divideCurrentCluster(minSplitSize_);
+}
+
+void ClusterTree::setMinSplitSize(int count) {
+    if(count < 1)
+        throw(std::runtime_error("ClusterTree::setMinSplitSize() - count must be positive"));
+    minSplitSize_ = count;
+}
+
+int ClusterTree::getMinSplitSize() const {
+    return minSplitSize_;
+}
+
+void ClusterTree::setMaxSplits(int count) {
+    maxSplits_ = count;
+}
+
+int ClusterTree::getMaxSplits() const {
+    return maxSplits_;
 }
 
 
 ClusterTree::Node& ClusterTree::getRoot() {
-    return *root_;
+    return nodes_[0];
 }
 
 Cluster& ClusterTree::getCurrentCluster() {
@@ -264,5 +1091,5 @@ Cluster& ClusterTree::getCurrentCluster() {
 }
 
 int ClusterTree::getNumDimensions() const {
-    return dataset_[0].size();
+    return dataset_.getNumDimensions();
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include "CompiledTree.h"
+#include "Dataset.h"
+#include "Buckets.h"
+
+using namespace std;
+
+namespace Terran {
+
+// points classified by one thread at a time in a batch
+static const int CHUNK_SIZE = 1024;
+
+// count points stored row-major, point n at data[n*D]
+template<typename T>
+struct RowMajorPoints {
+    RowMajorPoints(const T* data, int D) : data(data), D(D) {};
+    const T* operator[](int n) const {
+        return data+(size_t) n*D;
+    }
+    const T* data;
+    int D;
+};
+
+// point n of a dataset, read through its strides
+struct DatasetPoint {
+    DatasetPoint(const Dataset &data, int n) : data(data), n(n) {};
+    double operator[](int d) const {
+        return data(n, d);
+    }
+    const Dataset &data;
+    int n;
+};
+
+struct DatasetPoints {
+    explicit DatasetPoints(const Dataset &data) : data(data) {};
+    DatasetPoint operator[](int n) const {
+        return DatasetPoint(data, n);
+    }
+    const Dataset &data;
+};
+
+CompiledTree::CompiledTree() :
+    numDimensions_(0),
+    numClusters_(0) {
+
+}
+
+int CompiledTree::getNumDimensions() const {
+    return numDimensions_;
+}
+
+int CompiledTree::getNumClusters() const {
+    return numClusters_;
+}
+
+template<typename P>
+int CompiledTree::classifyPoint(const P &point) const {
+    const int D = numDimensions_;
+    int buckets[64];
+    vector<int> large;
+    int* tuple = buckets;
+    int i = 0;
+    while(nodes_[i].numChildren > 0) {
+        const Node &node = nodes_[i];
+        const int* starts = &cutStarts_[i*D];
+        if(node.table >= 0) {
+            const int* strides = &strides_[i*D];
+            int code = 0;
+            for(int d=0; d < D; d++) {
+                code += strides[d]*findBucket(point[d], &cuts_[0]+starts[d], starts[d+1]-starts[d], period_[d] != 0);
+            }
+            i = tables_[node.table+code];
+            continue;
+        }
+        if(D > 64 && large.empty()) {
+            large.resize(D);
+            tuple = &large[0];
+        }
+        for(int d=0; d < D; d++) {
+            tuple[d] = findBucket(point[d], &cuts_[0]+starts[d], starts[d+1]-starts[d], period_[d] != 0);
+        }
+        // children are sorted by their bucket tuples
+        int low = node.firstChild;
+        int high = node.firstChild+node.numChildren;
+        while(low < high) {
+            const int middle = (low+high)/2;
+            const int* other = &buckets_[middle*D];
+            if(lexicographical_compare(other, other+D, tuple, tuple+D))
+                low = middle+1;
+            else
+                high = middle;
+        }
+        if(low == node.firstChild+node.numChildren || !equal(tuple, tuple+D, &buckets_[low*D]))
+            low = nearestChild(i, tuple);
+        i = low;
+    }
+    return nodes_[i].leaf;
+}
+
+// the rule of bucketDistance() for a cell that held no points
+int CompiledTree::nearestChild(int i, const int* tuple) const {
+    const int D = numDimensions_;
+    const Node &node = nodes_[i];
+    const int* starts = &cutStarts_[i*D];
+    int best = node.firstChild;
+    int bestDistance = -1;
+    for(int k=node.firstChild; k < node.firstChild+node.numChildren; k++) {
+        int distance = 0;
+        for(int d=0; d < D; d++) {
+            distance += bucketDistance(buckets_[k*D+d], tuple[d], starts[d+1]-starts[d], period_[d] != 0);
+        }
+        if(bestDistance < 0 || distance < bestDistance) {
+            best = k;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+template<typename R>
+void CompiledTree::classifyBatch(const R &points, int count, int* clusters) const {
+    if(nodes_.empty())
+        throw(std::runtime_error("CompiledTree::classify() - tree is empty"));
+    const int numChunks = (count+CHUNK_SIZE-1)/CHUNK_SIZE;
+    #pragma omp parallel for schedule(dynamic) if(numChunks > 1)
+    for(int c=0; c < numChunks; c++) {
+        const int end = min(count, (c+1)*CHUNK_SIZE);
+        for(int n=c*CHUNK_SIZE; n < end; n++) {
+            clusters[n] = classifyPoint(points[n]);
+        }
+    }
+}
+
+int CompiledTree::classify(const double* point) const {
+    if(nodes_.empty())
+        throw(std::runtime_error("CompiledTree::classify() - tree is empty"));
+    return classifyPoint(point);
+}
+
+void CompiledTree::classify(const double* points, int count, int* clusters) const {
+    classifyBatch(RowMajorPoints<double>(points, numDimensions_), count, clusters);
+}
+
+void CompiledTree::classify(const float* points, int count, int* clusters) const {
+    classifyBatch(RowMajorPoints<float>(points, numDimensions_), count, clusters);
+}
+
+void CompiledTree::classify(const Dataset &points, int* clusters) const {
+    if(points.getNumDimensions() != numDimensions_ && points.getNumPoints() > 0)
+        throw(std::runtime_error("CompiledTree::classify() - dataset has wrong dimension"));
+    classifyBatch(DatasetPoints(points), points.getNumPoints(), clusters);
+}
+
+}
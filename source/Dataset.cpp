@@ -0,0 +1,298 @@
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include <algorithm>
+
+#include "Dataset.h"
+#include "MathFunctions.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+namespace Terran {
+
+// columns are padded to this many bytes so each one starts on a cache line
+static const size_t alignment = 64;
+
+static double* alignedAlloc(size_t count) {
+    if(count == 0)
+        return NULL;
+    void* ptr = NULL;
+#ifdef _WIN32
+    ptr = _aligned_malloc(count*sizeof(double), alignment);
+#else
+    if(posix_memalign(&ptr, alignment, count*sizeof(double)) != 0)
+        ptr = NULL;
+#endif
+    if(ptr == NULL)
+        throw(std::runtime_error("Dataset::allocate() - out of memory"));
+    return (double*) ptr;
+}
+
+static void alignedFree(double* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+Dataset::Dataset() :
+    numPoints_(0),
+    numDimensions_(0),
+    owned_(NULL),
+    base_(NULL),
+    isFloat_(false),
+    rowStride_(1),
+    columnStride_(0) {
+
+}
+
+Dataset::Dataset(const vector<vector<double> > &points) :
+    numPoints_(0),
+    numDimensions_(0),
+    owned_(NULL),
+    base_(NULL),
+    isFloat_(false),
+    rowStride_(1),
+    columnStride_(0) {
+
+    copyPoints(points);
+    period_.assign(numDimensions_, 0);
+}
+
+Dataset::Dataset(const vector<vector<double> > &points, const vector<int> &period) :
+    numPoints_(0),
+    numDimensions_(0),
+    owned_(NULL),
+    base_(NULL),
+    isFloat_(false),
+    rowStride_(1),
+    columnStride_(0),
+    period_(period) {
+
+    if(points.size() > 0 && points[0].size() != period_.size())
+        throw(std::runtime_error("Dataset::Dataset() - period size does not match data dimension"));
+
+    copyPoints(points);
+    if(numPoints_ == 0)
+        numDimensions_ = period_.size();
+
+    validate();
+}
+
+Dataset::Dataset(const double* data, int numPoints, int numDimensions, size_t rowStride, size_t columnStride, const vector<int> &period) :
+    numPoints_(0),
+    numDimensions_(0),
+    owned_(NULL),
+    base_(NULL),
+    isFloat_(false),
+    rowStride_(1),
+    columnStride_(0),
+    period_(period) {
+
+    setView(data, false, numPoints, numDimensions, rowStride, columnStride);
+    validate();
+}
+
+Dataset::Dataset(const float* data, int numPoints, int numDimensions, size_t rowStride, size_t columnStride, const vector<int> &period) :
+    numPoints_(0),
+    numDimensions_(0),
+    owned_(NULL),
+    base_(NULL),
+    isFloat_(false),
+    rowStride_(1),
+    columnStride_(0),
+    period_(period) {
+
+    setView(data, true, numPoints, numDimensions, rowStride, columnStride);
+    validate();
+}
+
+Dataset::Dataset(const Dataset &other) :
+    numPoints_(0),
+    numDimensions_(0),
+    owned_(NULL),
+    base_(NULL),
+    isFloat_(false),
+    rowStride_(1),
+    columnStride_(0) {
+    copyFrom(other);
+}
+
+Dataset& Dataset::operator=(const Dataset &other) {
+    if(this != &other) {
+        alignedFree(owned_);
+        owned_ = NULL;
+        copyFrom(other);
+    }
+    return *this;
+}
+
+Dataset::~Dataset() {
+    alignedFree(owned_);
+}
+
+void Dataset::copyFrom(const Dataset &other) {
+    period_ = other.period_;
+    if(other.owned_ == NULL && other.base_ != NULL) {
+        setView(other.base_, other.isFloat_, other.numPoints_, other.numDimensions_, other.rowStride_, other.columnStride_);
+        return;
+    }
+    allocate(other.numPoints_, other.numDimensions_);
+    // other may have room for more points than it holds
+    for(int d=0; d < numDimensions_; d++) {
+        memcpy(owned_+d*columnStride_, other.owned_+d*other.columnStride_, numPoints_*sizeof(double));
+    }
+}
+
+void Dataset::setView(const void* data, bool isFloat, int numPoints, int numDimensions, size_t rowStride, size_t columnStride) {
+    if(numPoints < 0 || numDimensions < 0)
+        throw(std::runtime_error("Dataset::Dataset() - negative size"));
+    if(data == NULL && numPoints > 0 && numDimensions > 0)
+        throw(std::runtime_error("Dataset::Dataset() - data is NULL"));
+    numPoints_ = numPoints;
+    numDimensions_ = numDimensions;
+    base_ = data;
+    isFloat_ = isFloat;
+    rowStride_ = rowStride;
+    columnStride_ = columnStride;
+}
+
+void Dataset::validate() const {
+	if(period_.size() != numDimensions_)
+		throw(std::runtime_error("Dataset::Dataset() - period size does not match data dimension"));
+
+	for(int i=0; i < period_.size(); i++) {
+		if(period_[i] != 1 && period_[i] != 0) {
+			throw(std::runtime_error("period must either be zero (false), or one (true)"));
+		}
+	}
+
+	for(int d=0; d < numDimensions_; d++) {
+		if(period_[d]) {
+			for(int n=0; n < numPoints_; n++) {
+				const double x = (*this)(n, d);
+				if(x < -PI || x > PI) {
+					stringstream error;
+					error << "Dataset::Dataset() - dimension " << d << " is periodic, but the angles are not in the range [-PI, to PI]" << endl;
+					throw(std::runtime_error(error.str()));
+				}
+			}
+		}
+	}
+}
+
+void Dataset::copyPoints(const vector<vector<double> > &points) {
+    for(int n=1; n < points.size(); n++) {
+        if(points[n].size() != points[n-1].size()) {
+            throw(std::runtime_error("Dataset::Dataset() - not all points have the same dimensions"));
+        }
+    }
+
+    allocate(points.size(), points.size() > 0 ? points[0].size() : 0);
+
+    for(int n=0; n < numPoints_; n++) {
+        const vector<double> &point = points[n];
+        for(int d=0; d < numDimensions_; d++) {
+            owned_[d*columnStride_+n] = point[d];
+        }
+    }
+}
+
+void Dataset::allocate(int numPoints, int numDimensions) {
+    const size_t perLine = alignment/sizeof(double);
+    numPoints_ = numPoints;
+    numDimensions_ = numDimensions;
+    isFloat_ = false;
+    rowStride_ = 1;
+    columnStride_ = (numPoints+perLine-1)/perLine*perLine;
+    owned_ = alignedAlloc(columnStride_*numDimensions_);
+    base_ = owned_;
+    // zero the padding so whole-line kernels never read garbage
+    if(owned_ != NULL)
+        memset(owned_, 0, columnStride_*numDimensions_*sizeof(double));
+}
+
+void Dataset::gather(int d, int first, int count, double* out) const {
+    const size_t offset = first*rowStride_+d*columnStride_;
+    if(isFloat_) {
+        const float* x = (const float*) base_+offset;
+        for(int i=0; i < count; i++)
+            out[i] = x[i*rowStride_];
+    } else if(rowStride_ == 1) {
+        memcpy(out, (const double*) base_+offset, count*sizeof(double));
+    } else {
+        const double* x = (const double*) base_+offset;
+        for(int i=0; i < count; i++)
+            out[i] = x[i*rowStride_];
+    }
+}
+
+void Dataset::gather(int d, const int* rows, int count, double* out) const {
+    const size_t offset = d*columnStride_;
+    if(isFloat_) {
+        const float* x = (const float*) base_+offset;
+        for(int i=0; i < count; i++)
+            out[i] = x[rows[i]*rowStride_];
+    } else {
+        const double* x = (const double*) base_+offset;
+        for(int i=0; i < count; i++)
+            out[i] = x[rows[i]*rowStride_];
+    }
+}
+
+void Dataset::append(const vector<vector<double> > &points) {
+    for(int n=0; n < points.size(); n++) {
+        if(points[n].size() != numDimensions_)
+            throw(std::runtime_error("Dataset::append() - point dimension does not match the dataset"));
+        for(int d=0; d < numDimensions_; d++) {
+            if(period_[d] && (points[n][d] < -PI || points[n][d] > PI)) {
+                stringstream error;
+                error << "Dataset::append() - dimension " << d << " is periodic, but the angles are not in the range [-PI, to PI]" << endl;
+                throw(std::runtime_error(error.str()));
+            }
+        }
+    }
+
+    const int numPoints = numPoints_+points.size();
+    if(owned_ == NULL || numPoints > columnStride_) {
+        const size_t perLine = alignment/sizeof(double);
+        const size_t capacity = (max<size_t>(numPoints, 2*numPoints_)+perLine-1)/perLine*perLine;
+        double* owned = alignedAlloc(capacity*numDimensions_);
+        if(owned != NULL)
+            memset(owned, 0, capacity*numDimensions_*sizeof(double));
+        for(int d=0; d < numDimensions_; d++) {
+            gather(d, 0, numPoints_, owned+d*capacity);
+        }
+        alignedFree(owned_);
+        owned_ = owned;
+        base_ = owned_;
+        isFloat_ = false;
+        rowStride_ = 1;
+        columnStride_ = capacity;
+    }
+    for(int n=0; n < points.size(); n++) {
+        for(int d=0; d < numDimensions_; d++) {
+            owned_[d*columnStride_+numPoints_+n] = points[n][d];
+        }
+    }
+    numPoints_ = numPoints;
+}
+
+vector<double> Dataset::getPoint(int n) const {
+    if(n < 0 || n >= numPoints_) {
+        throw(std::runtime_error("Dataset::getPoint() - n out of bounds!"));
+    }
+    vector<double> point(numDimensions_);
+    for(int d=0; d < numDimensions_; d++) {
+        point[d] = (*this)(n, d);
+    }
+    return point;
+}
+
+} // namespace Terran
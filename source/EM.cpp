@@ -6,6 +6,7 @@
 #include <sstream>
 #include <algorithm>
 #include <time.h>
+#include <stdlib.h>
 
 #ifdef _WIN32
 #define isinf(x) !_finite(x)
@@ -15,21 +16,33 @@ namespace Terran {
 
 using namespace std;
 
+static vector<double> sortedCopy(const vector<double> &data) {
+    vector<double> sorted(data);
+    sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
 EM::EM(const std::vector<double> &data) : 
-    data_(data),
+    data_(sortedCopy(data)),
+    cutoff_(10),
     //pikn_(data.size(), std::vector<double>(0)),
     maxSteps_(200),
-    tolerance_(0.1) {
+    tolerance_(0.1),
+    steps_(0),
+    seeded_(false) {
     if(data_.size() == 0)
         throw(std::runtime_error("Cannot initialize EM with empty dataset"));
 }
 
 EM::EM(const std::vector<double> &data, const std::vector<Param> &params) : 
-    data_(data),
+    data_(sortedCopy(data)),
     params_(params),
+    cutoff_(10),
     //pikn_(data.size(), std::vector<double>(params.size(),0)),
     maxSteps_(200),
-    tolerance_(0.1) {
+    tolerance_(0.1),
+    steps_(0),
+    seeded_(false) {
 
     if(data_.size() == 0)
         throw(std::runtime_error("Cannot initialize EM with empty dataset"));
@@ -41,6 +54,26 @@ EM::~EM() {
 
 }
 
+void EM::setData(const std::vector<double> &data) {
+    if(data.size() == 0)
+        throw(std::runtime_error("Cannot set EM data to an empty dataset"));
+    data_.assign(data.begin(), data.end());
+    sort(data_.begin(), data_.end());
+}
+
+void EM::reset() {
+    params_.resize(0);
+    cutoff_ = 10;
+    maxSteps_ = 200;
+    tolerance_ = 0.1;
+    steps_ = 0;
+}
+
+void EM::setSeed(unsigned long long seed) {
+    random_.setSeed(seed);
+    seeded_ = true;
+}
+
 // TODO: make this virtual and initialize pikn
 void EM::setParameters(const std::vector<Param> &input) {
     double psum = 0;
@@ -67,10 +100,18 @@ int EM::getDataSize() const {
     return data_.size();
 }
 
+const std::vector<double>& EM::getData() const {
+    return data_;
+}
+
 void EM::setMaxSteps(int maxSteps) {
     maxSteps_ = maxSteps;
 }
 
+int EM::getNumSteps() const {
+    return steps_;
+}
+
 int EM::getMaxSteps() const {
     return maxSteps_;
 }
@@ -83,6 +124,21 @@ double EM::getTolerance() const {
     return tolerance_;
 }
 
+void EM::setCutoff(double sigmas) {
+    if(sigmas <= 0)
+        throw(std::runtime_error("EM::setCutoff() - cutoff must be positive"));
+    cutoff_ = sigmas;
+}
+
+double EM::getCutoff() const {
+    return cutoff_;
+}
+
+void EM::findWindow(double left, double right, int &begin, int &end) const {
+    begin = lower_bound(data_.begin(), data_.end(), left) - data_.begin();
+    end = upper_bound(data_.begin()+begin, data_.end(), right) - data_.begin();
+}
+
 bool EM::run() {
     if(params_.size() == 0) {
         throw(std::runtime_error("EM::run(), parameters are not set"));
@@ -93,12 +149,11 @@ bool EM::run() {
     int steps = 0;
     double likelihood = getLikelihood();
     double likelihoodOld;
-    // keep an old copy of params
-    vector<Param> paramsOld;
 
     do {
         likelihoodOld = likelihood;
-        paramsOld = params_;
+        // keep an old copy of params
+        paramsOld_ = params_;
         EStep();
         MStep();   
         steps++;
@@ -110,7 +165,7 @@ bool EM::run() {
 
         // likelihood decreases normally if a convergence criterion has been reached
         if(likelihood < likelihoodOld) {
-            params_ = paramsOld;
+            params_ = paramsOld_;
             break; 
         }
     // Stop EM if:
@@ -120,6 +175,7 @@ bool EM::run() {
 
 	destroyPink();
 
+    steps_ = steps;
     return (steps < maxSteps_);
 }
 
@@ -127,33 +183,28 @@ bool paramSorter(const Param &p1, const Param &p2) {
     return p1.u < p2.u;
 }
 
-double EM::getLikelihood() const {
-    double lambda = 0;
-    for(int n=0; n<data_.size(); n++) {
-        double sum = 0;
-        for(int k=0; k<params_.size(); k++) {
-            sum += qkn(k,n);
-        }
-        lambda += log(sum);
-    }
-    return lambda;
-}
-
 bool EM::simpleRun(unsigned int numParams) {
     
 	if(numParams > data_.size()) {
         throw(std::runtime_error("EM::simpleRun(), numParams > number of data points"));
     }
 
-    // initialize parameters by sampling from the data
-    vector<double> randomSample = data_;
-    random_shuffle(randomSample.begin(), randomSample.end());
-    randomSample.resize(numParams);
+    // rand() is only touched when no seed was given, so seeded runs neither
+    // contend on its lock nor move the caller's srand() stream
+    if(!seeded_)
+        setSeed(Random::seedFromRand());
+
+    // initialize parameters by sampling from the data, only the first
+    // numParams places of the shuffle are needed
+    sample_.assign(data_.begin(), data_.end());
+    for(int i=0; i < numParams; i++) {
+        swap(sample_[i], sample_[i+random_.index(sample_.size()-i)]);
+    }
     params_.resize(numParams);
 
-    for(int i=0; i < randomSample.size(); i++) {
-        params_[i].p = (double) 1 / randomSample.size();
-        params_[i].u = randomSample[i];
+    for(int i=0; i < numParams; i++) {
+        params_[i].p = (double) 1 / numParams;
+        params_[i].u = sample_[i];
         params_[i].s = 0.1*domainLength();
     }
 
@@ -162,7 +213,7 @@ bool EM::simpleRun(unsigned int numParams) {
     double likelihood = getLikelihood();
     double likelihoodOld;
     do {
-        vector<Param> paramsOld = params_;
+        paramsOld_ = params_;
 		likelihoodOld = likelihood;
 		EStep();
 		MStep();
@@ -180,7 +231,7 @@ bool EM::simpleRun(unsigned int numParams) {
         // rethink termination criteria if there are merges happening
         if(fabs(likelihood - likelihoodOld) < tolerance_) {
             if(likelihood < likelihoodOld) {
-                params_ = paramsOld;
+                params_ = paramsOld_;
             }
             break;
         }
@@ -192,6 +243,7 @@ bool EM::simpleRun(unsigned int numParams) {
 	
 	destroyPink();
 
+    steps_ = steps;
     return steps < maxSteps_;
 }
 
@@ -6,19 +6,17 @@
 
 namespace Terran {
 
-EMGaussian::EMGaussian(const std::vector<double> &data) : 
-    EM(data),
-	pink_(data.size(), std::vector<double>(0)) {
+template<FastMathAccuracy A> EMGaussianAt<A>::EMGaussianAt(const std::vector<double> &data) : 
+    EMCore<GaussianModel<A> >(data, 0) {
 
 }
 
-EMGaussian::EMGaussian(const std::vector<double> &data, const std::vector<Param> &params) : 
-    EM(data, params),
-	pink_(data.size(), std::vector<double>(0)) {
+template<FastMathAccuracy A> EMGaussianAt<A>::EMGaussianAt(const std::vector<double> &data, const std::vector<Param> &params) : 
+    EMCore<GaussianModel<A> >(data, params, 0) {
 
 }
 
-EMGaussian::~EMGaussian() { 
+template<FastMathAccuracy A> EMGaussianAt<A>::~EMGaussianAt() { 
 
 }
 
@@ -87,25 +85,27 @@ static bool paramComparator(const Param &a, const Param&b) {
     return a.u < b.u;
 }
 
-void EMGaussian::mergeParams() {
+// the merge does not depend on the accuracy of the kernels, so it is shared
+// by every EMGaussianAt
+static void mergeGaussianParams(vector<Param> &params) {
 
-    sort(params_.begin(), params_.end(), paramComparator);
-    vector<bool> skip(params_.size(), 0);
+    sort(params.begin(), params.end(), paramComparator);
+    vector<bool> skip(params.size(), 0);
 
     // final set of parameters
     vector<Param> refined;
 
-    for(int i=0; i < params_.size(); i++) {
+    for(int i=0; i < params.size(); i++) {
         // if this parameter has not already been merged
         if(!skip[i]) {
             // find longest continuous sequence of parameters 
             // that can be merged into a single parameter
             bool hasMergedOnce = false;
             vector<Param> candidates;
-            Param best = params_[i]; 
-            candidates.push_back(params_[i]);
-            for(int j=i+1; j < params_.size(); j++) {
-                candidates.push_back(params_[j]);
+            Param best = params[i]; 
+            candidates.push_back(params[i]);
+            for(int j=i+1; j < params.size(); j++) {
+                candidates.push_back(params[j]);
                 Param estimate = estimator(candidates);
 
                 double squaredError = squaredIntegratedError(candidates, estimate);
@@ -127,77 +127,23 @@ void EMGaussian::mergeParams() {
         }
     }
      
-    if(refined.size() != params_.size()) {
-        params_ = refined;
+    if(refined.size() != params.size()) {
+        params = refined;
     }
 
 }
 
-void EMGaussian::initializePink() {
-	for(int i=0; i < pink_.size(); i++) {
-        pink_[i].resize(params_.size(), 0);
-    }
-}
-
-void EMGaussian::destroyPink() {
-	pink_.resize(0);
-}
-
-void EMGaussian::EStep() {
-    for(int n=0; n<data_.size(); n++) {
-        double denominator = gaussianMixture(params_, data_[n]);
-        for(int k=0; k<params_.size(); k++) {
-            if(denominator > 1e-7)
-                pink_[n][k] = qkn(k,n)/denominator;
-            else
-                pink_[n][k] = 0;
-        }
-    }
-}
-
-void EMGaussian::MStep() {
-    for(int k=0; k<params_.size(); k++) {
-		//cout << k << endl;
-        // Compute new mean
-        double numeratorSum = 0;
-        double denominatorSum = 0;
-        for(int n=0; n<data_.size(); n++) {
-            numeratorSum += pink_[n][k]*data_[n];
-        }
-        for(int n=0; n<data_.size(); n++) {
-            denominatorSum += pink_[n][k];
-        }
-        params_[k].u = numeratorSum / denominatorSum;
-
-        // Compute new standard deviation
-        numeratorSum = 0;
-        for(int n=0; n<data_.size(); n++) {
-            double dx = data_[n]-params_[k].u;
-            numeratorSum += pink_[n][k]*dx*dx;
-        }
-        params_[k].s = sqrt(numeratorSum / denominatorSum);
-
-        // Compute new probability
-        params_[k].p = denominatorSum / data_.size(); 
-    }
+template<FastMathAccuracy A> void EMGaussianAt<A>::mergeParams() {
+    mergeGaussianParams(this->params_);
 }
 
-double EMGaussian::qkn(int k, int n) const {
-   double pk = params_[k].p;
-   double uk = params_[k].u;
-   double sk = params_[k].s;    
-   double xn = data_[n];
-   return pk * gaussian(uk, sk, xn);
+template<FastMathAccuracy A> double EMGaussianAt<A>::domainLength() const {
+    // data_ is sorted
+    return this->data_.back()-this->data_.front();
 }
 
-double EMGaussian::domainLength() const {
-    double min =  numeric_limits<double>::max();
-    double max = -numeric_limits<double>::max();
-    for(int i=0; i < data_.size(); i++) {
-        min = (data_[i] < min) ? data_[i] : min;
-        max = (data_[i] > max) ? data_[i] : max;
-    }
-    return max-min;
-}
+template class EMGaussianAt<FAST_MATH_1E6>;
+template class EMGaussianAt<FAST_MATH_1E12>;
+template class EMGaussianAt<FAST_MATH_LIBM>;
 
 }
@@ -11,35 +11,31 @@ using namespace std;
 
 namespace Terran {
 
-EMPeriodicGaussian::EMPeriodicGaussian(const vector<double> &data,  double period) : 
-    EM(data), 
-    period_(period) {
-    for(int i=0; i<params_.size(); i++) {
-        if(params_[i].s > period_)
+template<FastMathAccuracy A> EMPeriodicGaussianAt<A>::EMPeriodicGaussianAt(const vector<double> &data,  double period) : 
+    EMCore<WrappedGaussianModel<7, A> >(data, period) {
+    for(int i=0; i<this->params_.size(); i++) {
+        if(this->params_[i].s > this->period_)
             throw(std::runtime_error("Cannot have s > period in parameters"));
-        if(params_[i].u < -period_/2)
+        if(this->params_[i].u < -this->period_/2)
             throw(std::runtime_error("Cannot have u < -period/2"));
-        if(params_[i].u > period_/2)
+        if(this->params_[i].u > this->period_/2)
             throw(std::runtime_error("Cannot have u > period/2"));
     }
-	initializePink();
 }
 
-EMPeriodicGaussian::EMPeriodicGaussian(const vector<double> &data, const vector<Param> &params, double period) : 
-    EM(data, params), 
-    period_(period) {
+template<FastMathAccuracy A> EMPeriodicGaussianAt<A>::EMPeriodicGaussianAt(const vector<double> &data, const vector<Param> &params, double period) : 
+    EMCore<WrappedGaussianModel<7, A> >(data, params, period) {
     for(int i=0; i<params.size(); i++) {
-        if(params_[i].s > period_)
+        if(this->params_[i].s > this->period_)
             throw(std::runtime_error("Cannot have s > period in parameters"));
-        if(params_[i].u < -period_/2)
+        if(this->params_[i].u < -this->period_/2)
             throw(std::runtime_error("Cannot have u < -period/2"));
-        if(params_[i].u > period_/2)
+        if(this->params_[i].u > this->period_/2)
             throw(std::runtime_error("Cannot have u > period/2"));
     }
-	initializePink();
 }
 
-EMPeriodicGaussian::~EMPeriodicGaussian() {
+template<FastMathAccuracy A> EMPeriodicGaussianAt<A>::~EMPeriodicGaussianAt() {
 
 }
 
@@ -75,49 +71,41 @@ static Param estimator(const vector<Param> &source) {
 	return estimate;
 }
 
-static double normalCDF(double x, double u, double s) {
-	double prefix = 0.5;
-	double suffix = 1.0+erf((x-u)/(s*sqrt(2.0)));
-    return prefix*suffix;
-}
-
+// overlap integral of two wrapped gaussians over one period. Unrolling one of
+// the image sums turns it into a single wrapped gaussian of the difference in
+// means with variance s1^2+s2^2, so only the images of one gaussian are summed;
+// for wide components the dual fourier series of the same function is used
+// instead as it needs fewer terms.
 static double normalizer(const Param &a, const Param &b) {
-    double p1 = a.p;
-    double p2 = b.p;
-    double u1 = a.u;
-    double u2 = b.u;
-    double s1 = a.s;
-    double s2 = b.s;
+    const double period = 2*PI;
+    double s = sqrt(a.s*a.s+b.s*b.s);
+    double d = periodicDifference(a.u, b.u, period);
     double sum = 0;
-    for(int r1=-6; r1 <=6; r1++) {
-        for(int r2=-6; r2 <=6; r2++) {
-            double u1_n = u1+r1*2*PI;
-            double u2_n = u2+r2*2*PI;
-            double top = exp(-0.5*((u1_n-u2_n)*(u1_n-u2_n))/(s1*s1+s2*s2));
-            double bot = sqrt(2*PI*(s1*s1+s2*s2));
-            double u_new = (u1_n*s2*s2+u2_n*s1*s1)/(s2*s2+s1*s1);
-            double s_new = (s1*s2)/sqrt(s1*s1+s2*s2);
-            sum += (top/bot) * (normalCDF(PI,u_new,s_new)-normalCDF(-PI,u_new,s_new));
+    if(s < 2) {
+        // images further than 7 sigma away contribute less than 1e-11 relative
+        int images = floor(7*s/period+0.5);
+        for(int r=-images; r <= images; r++) {
+            double x = d+r*period;
+            sum += exp(-0.5*x*x/(s*s));
+        }
+        sum /= sqrt(2*PI)*s;
+    } else {
+        // exp(-k^2 s^2/2) drops below 1e-17 at k = 8.9/s
+        int terms = ceil(8.9/s);
+        for(int k=1; k <= terms; k++) {
+            sum += exp(-0.5*k*k*s*s)*cos(k*d);
         }
+        sum = (1+2*sum)/period;
     }
-    return p1*p2*sum;
+    return a.p*b.p*sum;
 }
 
-// integrated squared error 
-static double squaredIntegratedError(const vector<Param> &params, const Param &estimate) {
-    double left = 0;
+// integrated squared error of the parameters and the estimate, where left is
+// the self overlap of the parameters
+static double squaredIntegratedError(const vector<Param> &params, const Param &estimate, double left) {
     double middle = 0;
     double right = 0;
     for(int i=0; i < params.size(); i++) {
-        double p1 = params[i].p;
-        double u1 = params[i].u;
-        double s1 = params[i].s;
-        for(int j=0; j < params.size(); j++) {
-            double p2 = params[j].p;
-            double u2 = params[j].u;
-            double s2 = params[j].s;
-            left += normalizer(params[i], params[j]);
-        }
         middle += normalizer(params[i], estimate);
     }
     right = normalizer(estimate, estimate);
@@ -129,37 +117,42 @@ static bool paramComparator(const Param &a, const Param&b) {
     return a.u < b.u;
 }
 
-const int numImages = 7;
-
-void EMPeriodicGaussian::initializePink() {
-	// yuck.
-	vector<vector<vector<double> > > init(data_.size(), vector<vector<double> >(params_.size(), vector<double>(2*numImages+1, 0)));
-	pinkr_ = init;
-}
-
-void EMPeriodicGaussian::destroyPink() {
-	pinkr_.resize(0);
-}
-
-void EMPeriodicGaussian::mergeParams() {
+// the merge does not depend on the accuracy of the kernels, so it is shared
+// by every EMPeriodicGaussianAt
+static void mergePeriodicParams(vector<Param> &params) {
 
-    sort(params_.begin(), params_.end(), paramComparator);
-    vector<bool> skip(params_.size(), 0);
+    sort(params.begin(), params.end(), paramComparator);
+    vector<bool> skip(params.size(), 0);
+    // pairwise overlaps are shared by every candidate run in this pass
+    const int numParams = params.size();
+    vector<double> overlaps(numParams*numParams);
+    for(int i=0; i < numParams; i++) {
+        for(int j=i; j < numParams; j++) {
+            overlaps[i*numParams+j] = normalizer(params[i], params[j]);
+            overlaps[j*numParams+i] = overlaps[i*numParams+j];
+        }
+    }
     // final set of parameters
     vector<Param> refined;
-    for(int i=0; i < params_.size(); i++) {
+    for(int i=0; i < params.size(); i++) {
         // if this parameter has not already been merged
         if(!skip[i]) {
             // find longest continuous sequence of parameters 
             // that can be merged into a single parameter
             bool hasMergedOnce = false;
             vector<Param> candidates;
-            Param best = params_[i]; 
-            candidates.push_back(params_[i]);
-            for(int j=(i+1) % params_.size(); j != i; j = (j+1) % params_.size()) {
-                candidates.push_back(params_[j]);
+            Param best = params[i]; 
+            candidates.push_back(params[i]);
+            double left = overlaps[i*numParams+i];
+            for(int j=(i+1) % params.size(); j != i; j = (j+1) % params.size()) {
+                candidates.push_back(params[j]);
+                // grow the self overlap by the cross terms of the new member
+                for(int k=i; k != j; k = (k+1) % params.size()) {
+                    left += 2*overlaps[k*numParams+j];
+                }
+                left += overlaps[j*numParams+j];
                 Param estimate = estimator(candidates);
-                double squaredError = squaredIntegratedError(candidates, estimate);
+                double squaredError = squaredIntegratedError(candidates, estimate, left);
                 if(sqrt(squaredError) < 5e-3) {
                     hasMergedOnce = true;
                     best = estimate;
@@ -178,74 +171,21 @@ void EMPeriodicGaussian::mergeParams() {
         }
     }
      
-    if(refined.size() != params_.size()) {
-        params_ = refined;
+    if(refined.size() != params.size()) {
+        params = refined;
     }
 }
 
-void EMPeriodicGaussian::EStep() {
-	for(int n=0 ; n < data_.size(); n++) {
-		double bot = periodicGaussianMixture(params_, data_[n], period_);
-		for(int k=0; k < params_.size(); k++) {
-			double topsum = 0;
-            for(int r = -numImages; r <= numImages; r++) {
-				double top = params_[k].p*gaussian(params_[k].u, params_[k].s, data_[n]-period_*r);
-				//pinkr_[n][k][r+numImages] = top/bot;
-                if(bot > 1e-7)
-					pinkr_[n][k][r+numImages] = top/bot;
-				else
-					pinkr_[n][k][r+numImages] = 0;
-			
-			}
-		}
-    }	
-}
-
-void EMPeriodicGaussian::MStep() {
-    for(int k=0; k < params_.size(); k++) {
-		// compute new probability and normalization constant
-		double normalization;
-        double sum = 0;
-        for(int n=0; n < data_.size(); n++) {   
-            for(int r = -numImages; r <= numImages; r++) {
-                sum += pinkr_[n][k][r+numImages];
-            }
-        }
-
-        normalization = sum;
-		params_[k].p = sum/data_.size();
-
-		// compute new mean
-        double numerator = 0;
-        for(int n=0; n < data_.size(); n++) {
-            for(int r=-numImages; r <= numImages; r++) {
-                numerator += pinkr_[n][k][r+numImages]*(data_[n]-r*period_);
-            }
-        }
-		params_[k].u = numerator/normalization;
-
-		// compute new standard deviation
-        numerator = 0;
-        for(int n=0; n < data_.size(); n++) {
-            for(int r=-numImages; r <= numImages; r++) {
-                double a = data_[n]-params_[k].u-r*period_;
-                numerator += pinkr_[n][k][r+numImages]*(a*a);
-            }
-        }
-        params_[k].s = sqrt(numerator/normalization);
-	}
+template<FastMathAccuracy A> void EMPeriodicGaussianAt<A>::mergeParams() {
+    mergePeriodicParams(this->params_);
 }
 
-double EMPeriodicGaussian::domainLength() const {
-    return period_;
+template<FastMathAccuracy A> double EMPeriodicGaussianAt<A>::domainLength() const {
+    return this->period_;
 }
 
-double EMPeriodicGaussian::qkn(int k, int n) const {
-    double xn = data_[n];
-    double pk = params_[k].p;
-    double uk = params_[k].u;
-    double sk = params_[k].s;
-    return pk*periodicGaussian(uk,sk,xn,period_);
-}
+template class EMPeriodicGaussianAt<FAST_MATH_1E6>;
+template class EMPeriodicGaussianAt<FAST_MATH_1E12>;
+template class EMPeriodicGaussianAt<FAST_MATH_LIBM>;
 
 }
@@ -1,4 +1,5 @@
 #include "MethodsGaussian.h"
+#include "MixtureSampler.h"
 #include <stdexcept>
 #include <assert.h>
 #include <iostream>
@@ -30,12 +31,23 @@ static bool compare_by_x(double2 a, double2 b) {
 }
 
 MethodsGaussian::MethodsGaussian(const vector<Param> &params) : Methods(params) {
+	MixtureSampler sampler(params_);
+	findBrackets(sampler);
+}
+
+MethodsGaussian::MethodsGaussian(const vector<Param> &params, unsigned long long seed) : Methods(params) {
+	MixtureSampler sampler(params_);
+	sampler.setSeed(seed);
+	findBrackets(sampler);
+}
+
+void MethodsGaussian::findBrackets(MixtureSampler &sampler) {
 
 	// sample from the distribution directly
 	vector<double2> samples;
 	for(int i=0; i <2500; i++) {
 		double2 sample;
-		sample.x = gaussianMixtureSample(params_);
+		sample.x = sampler.sample();
 		sample.y = gaussianMixture(params_, sample.x);
 		samples.push_back(sample);
 	}
@@ -1,4 +1,5 @@
 #include "MethodsPeriodicGaussian.h"
+#include "MixtureSampler.h"
 #include <stdexcept>
 #include <assert.h>
 #include <iostream>
@@ -31,11 +32,23 @@ static bool compare_by_x(double2 a, double2 b) {
 
 MethodsPeriodicGaussian::MethodsPeriodicGaussian(const vector<Param> &params, 
     double period) : Methods(params), period_(period) {
+	MixtureSampler sampler(params_, period_);
+	findBrackets(sampler);
+}
+
+MethodsPeriodicGaussian::MethodsPeriodicGaussian(const vector<Param> &params, 
+    double period, unsigned long long seed) : Methods(params), period_(period) {
+	MixtureSampler sampler(params_, period_);
+	sampler.setSeed(seed);
+	findBrackets(sampler);
+}
+
+void MethodsPeriodicGaussian::findBrackets(MixtureSampler &sampler) {
 	// sample from the distribution directly
 	vector<double2> samples;
 	for(int i=0; i <2500; i++) {
 		double2 sample;
-		sample.x = periodicGaussianMixtureSample(params_, period_);
+		sample.x = sampler.sample();
 		sample.y = periodicGaussianMixture(params_, sample.x, period_);
 		samples.push_back(sample);
 	}
@@ -0,0 +1,115 @@
+#include "MixtureSampler.h"
+
+#include <stdexcept>
+#include <stdlib.h>
+#include <math.h>
+
+using namespace std;
+
+namespace Terran {
+
+MixtureSampler::MixtureSampler(const vector<Param> &params) :
+    params_(params),
+    period_(0),
+    seeded_(false) {
+    initialize();
+}
+
+MixtureSampler::MixtureSampler(const vector<Param> &params, double period) :
+    params_(params),
+    period_(period),
+    seeded_(false) {
+    if(period <= 0) {
+        throw(std::runtime_error("MixtureSampler::MixtureSampler() - period must be positive"));
+    }
+    initialize();
+}
+
+// Vose's alias method
+void MixtureSampler::initialize() {
+    if(params_.size() == 0) {
+        throw(std::runtime_error("MixtureSampler::initialize() - no parameters given"));
+    }
+
+    double total = 0;
+    for(int k=0; k < params_.size(); k++) {
+        if(params_[k].p < 0)
+            throw(std::runtime_error("MixtureSampler::initialize() - cannot have p < 0 in parameters"));
+        total += params_[k].p;
+    }
+    if(total <= 0) {
+        throw(std::runtime_error("MixtureSampler::initialize() - probabilities sum to zero"));
+    }
+
+    const int K = params_.size();
+    probability_.resize(K);
+    alias_.resize(K);
+
+    vector<double> scaled(K);
+    vector<int> small;
+    vector<int> large;
+    for(int k=0; k < K; k++) {
+        scaled[k] = params_[k].p*K/total;
+        if(scaled[k] < 1)
+            small.push_back(k);
+        else
+            large.push_back(k);
+    }
+
+    while(small.size() > 0 && large.size() > 0) {
+        int s = small.back();
+        small.pop_back();
+        int l = large.back();
+        probability_[s] = scaled[s];
+        alias_[s] = l;
+        scaled[l] = (scaled[l]+scaled[s])-1;
+        if(scaled[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // leftovers are due to numerical imprecision and are always selected
+    for(int i=0; i < large.size(); i++) {
+        probability_[large[i]] = 1;
+        alias_[large[i]] = large[i];
+    }
+    for(int i=0; i < small.size(); i++) {
+        probability_[small[i]] = 1;
+        alias_[small[i]] = small[i];
+    }
+}
+
+void MixtureSampler::setSeed(unsigned long long seed) {
+    random_.setSeed(seed);
+    seeded_ = true;
+}
+
+double MixtureSampler::sample() {
+    // rand() is only touched when no seed was given
+    if(!seeded_)
+        setSeed(Random::seedFromRand());
+    double u = random_.uniform()*probability_.size();
+    int k = (int) u;
+    if(k >= probability_.size())
+        k = probability_.size()-1;
+    if(u-k >= probability_[k])
+        k = alias_[k];
+
+    double x = params_[k].u+params_[k].s*random_.normal();
+    if(period_ > 0)
+        x -= floor(x/period_+0.5)*period_;
+    return x;
+}
+
+void MixtureSampler::sample(vector<double> &samples) {
+    for(int i=0; i < samples.size(); i++) {
+        samples[i] = sample();
+    }
+}
+
+double MixtureSampler::getPeriod() const {
+    return period_;
+}
+
+}
@@ -0,0 +1,61 @@
+#include <math.h>
+#include <algorithm>
+
+#include "Modality.h"
+#include "MathFunctions.h"
+
+using namespace std;
+
+namespace Terran {
+
+static vector<int> histogram(const vector<double> &data, bool periodic) {
+    const int N = data.size();
+    const int bins = max(4, min(256, (int) (2*pow((double) N, 1.0/3))));
+    double left = -PI;
+    double right = PI;
+    if(!periodic) {
+        left = *min_element(data.begin(), data.end());
+        right = *max_element(data.begin(), data.end());
+    }
+    vector<int> counts(bins, 0);
+    if(right <= left) {
+        counts[0] = N;
+        return counts;
+    }
+    const double scale = bins/(right-left);
+    for(int i=0; i < N; i++) {
+        const int b = (int) ((data[i]-left)*scale);
+        counts[min(max(b, 0), bins-1)]++;
+    }
+    return counts;
+}
+
+// a cyclic histogram is unrolled to start at its lowest bin. A single mode
+// then has no valley, and with several modes every valley but the cut one
+// lies between two peaks of the unrolled sequence.
+double multimodality(const vector<double> &data, bool periodic) {
+    if(data.size() == 0)
+        return 0;
+    vector<int> counts = histogram(data, periodic);
+    if(periodic) {
+        rotate(counts.begin(), min_element(counts.begin(), counts.end()), counts.end());
+    }
+    const int bins = counts.size();
+    vector<int> rightMax(bins);
+    rightMax[bins-1] = counts[bins-1];
+    for(int i=bins-2; i >= 0; i--) {
+        rightMax[i] = max(rightMax[i+1], counts[i]);
+    }
+    double score = 0;
+    int leftMax = 0;
+    for(int i=0; i < bins; i++) {
+        leftMax = max(leftMax, counts[i]);
+        const int peak = min(leftMax, rightMax[i]);
+        if(peak > counts[i]) {
+            score = max(score, (peak-counts[i])/sqrt((double) peak+counts[i]));
+        }
+    }
+    return score;
+}
+
+}
@@ -3,26 +3,129 @@
 #include "EMPeriodicGaussian.h"
 #include "MethodsPeriodicGaussian.h"
 #include "MethodsGaussian.h"
+#include "Modality.h"
 
 #include <sstream>
+#include <cmath>
 #include <algorithm>
 
 using namespace std;
 using namespace Terran;
 
+// a single component matching the mean and standard deviation of the data, or
+// for periodic data its circular mean and circular standard deviation. s is 0
+// if the data has no spread. The model of screened data.
+static Param fitSingle(const vector<double> &data, bool isPeriodic) {
+	const int n = data.size();
+	if(n == 0)
+		return Param();
+	double a = 0;
+	double b = 0;
+	for(int i=0; i < n; i++) {
+		a += isPeriodic ? cos(data[i]) : data[i];
+		b += isPeriodic ? sin(data[i]) : data[i]*data[i];
+	}
+	double u;
+	double s;
+	if(isPeriodic) {
+		const double r = sqrt(a*a+b*b)/n;
+		u = atan2(b, a);
+		s = r > 0 && r < 1 ? sqrt(-2*log(r)) : 0;
+	} else {
+		u = a/n;
+		s = sqrt(max(0.0, b/n-u*u));
+	}
+	return Param(1, u, s);
+}
+
+// A workspace holds one EM object of each kind together with all of their data,
+// responsibility and scratch buffers. Partitioners are created per dimension and
+// per node, so rather than building a new EM object every time they borrow a
+// workspace from a pool and give it back when they are destroyed. At most one
+// workspace per concurrently running partitioner is ever created, and in steady
+// state the EM buffers are not reallocated.
+//
+// Every thread keeps its own list of free workspaces, so borrowing one takes no
+// lock. A partitioner is destroyed by the thread that created it, as tasks are
+// tied to their thread, and returns its workspace to that thread's list. Only
+// the first use of the pool by a thread registers its list, which is what lets
+// the pool free every workspace at exit.
+struct PartitionerEM::Workspace {
+	Workspace() : gaussian(NULL), periodicGaussian(NULL) {}
+	~Workspace() {
+		delete gaussian;
+		delete periodicGaussian;
+	}
+	EMGaussian* gaussian;
+	EMPeriodicGaussian* periodicGaussian;
+};
+
+struct PartitionerEM::WorkspacePool {
+	~WorkspacePool() {
+		for(int i=0; i < lists.size(); i++) {
+			for(int j=0; j < lists[i]->size(); j++) {
+				delete (*lists[i])[j];
+			}
+			delete lists[i];
+		}
+	}
+
+	Workspace* acquire() {
+		std::vector<Workspace*> &free = getLocal();
+		if(free.size() == 0)
+			return new Workspace;
+		Workspace* workspace = free.back();
+		free.pop_back();
+		return workspace;
+	}
+
+	void release(Workspace* workspace) {
+		getLocal().push_back(workspace);
+	}
+
+	std::vector<Workspace*>& getLocal() {
+		if(local == NULL) {
+			local = new std::vector<Workspace*>;
+			#pragma omp critical(TerranWorkspacePool)
+			lists.push_back(local);
+		}
+		return *local;
+	}
+
+	// the free list of the calling thread
+	static std::vector<Workspace*>* local;
+	#pragma omp threadprivate(local)
+
+	// the free lists of every thread that used the pool
+	std::vector<std::vector<Workspace*>*> lists;
+};
+
+std::vector<PartitionerEM::Workspace*>* PartitionerEM::WorkspacePool::local = NULL;
+
+PartitionerEM::WorkspacePool PartitionerEM::pool_;
+
 PartitionerEM::PartitionerEM() :
 	Partitioner(),
 	partitionCutoff_(0.01),
+	screening_(false),
+	screeningTolerance_(3),
+	screened_(false),
+	hasSeed_(false),
+	seed_(0),
+	workspace_(NULL),
 	em_(NULL),
 	initialK_(50) {
 
 }
 
 PartitionerEM::~PartitionerEM() {
-	delete em_;
+	if(workspace_ != NULL)
+		pool_.release(workspace_);
 }
 
 void PartitionerEM::optimizeParameters() {
+	if(hasSeed_)
+		em_->setSeed(Random::derive(seed_, 0));
     em_->simpleRun(initialK_);
 }
 
@@ -40,17 +143,28 @@ void PartitionerEM::setDataAndPeriod(const vector<double> &data, bool isPeriodic
 		}
 	}
 
-	// delete the old em_ object
-	if(em_ != NULL) {
-		delete em_;
-		em_ = NULL;
-	}
+	screened_ = false;
 
-	// instantiate a new em_ object
+	if(workspace_ == NULL)
+		workspace_ = pool_.acquire();
+
+	// reuse the workspace's em object, it behaves like a newly constructed one
     if(isPeriodic) {
-        em_ = new EMPeriodicGaussian(data, 2*PI);
+        if(workspace_->periodicGaussian == NULL) {
+            workspace_->periodicGaussian = new EMPeriodicGaussian(data, 2*PI);
+        } else {
+            workspace_->periodicGaussian->setData(data);
+            workspace_->periodicGaussian->reset();
+        }
+        em_ = workspace_->periodicGaussian;
     } else {
-        em_ = new EMGaussian(data);
+        if(workspace_->gaussian == NULL) {
+            workspace_->gaussian = new EMGaussian(data);
+        } else {
+            workspace_->gaussian->setData(data);
+            workspace_->gaussian->reset();
+        }
+        em_ = workspace_->gaussian;
     }
 
 }
@@ -61,13 +175,38 @@ Partitioner* PartitionerEM::clone(const std::vector<double> &data, bool isPeriod
 	pem->isPeriodic_ = isPeriodic;
 	pem->initialK_ = this->initialK_;
 	pem->partitionCutoff_ = this->partitionCutoff_;
+	pem->screening_ = this->screening_;
+	pem->screeningTolerance_ = this->screeningTolerance_;
+	pem->hasSeed_ = this->hasSeed_;
+	pem->seed_ = this->seed_;
 	return pem;
 }
 
+void PartitionerEM::setSeed(unsigned long long seed) {
+	hasSeed_ = true;
+	seed_ = seed;
+}
+
+int PartitionerEM::getIterations() const {
+	return (em_ != NULL && !screened_) ? em_->getNumSteps() : 0;
+}
+
 std::vector<double> PartitionerEM::partition() {
 	if(em_ == NULL) {
 		throw(std::runtime_error("PartitionEM::findLowMinima() - dataset_ has not been initialized"));
 	}
+	// both passes are linear in the data, so they are cheap compared to the
+	// fit they may save, and are only made when screening is on
+	screened_ = false;
+	if(screening_) {
+		const vector<double> &data = em_->getData();
+		screened_ = multimodality(data, isPeriodic_) <= screeningTolerance_;
+		if(screened_) {
+			const Param single = fitSingle(data, isPeriodic_);
+			em_->setParameters(single.s > 0 ? vector<Param>(1, single) : vector<Param>());
+			return vector<double>();
+		}
+	}
     optimizeParameters();
 	vector<double> points = findLowMinima();
 	return points;
@@ -82,8 +221,9 @@ vector<double> PartitionerEM::findLowMinima() const {
     vector<double> partition;
     if(isPeriodic_) {
         const double period = 2*PI;
-        MethodsPeriodicGaussian mpg(params, period);
-        vector<double> minima = mpg.findMinima();
+        vector<double> minima = hasSeed_ ?
+            MethodsPeriodicGaussian(params, period, Random::derive(seed_, 1)).findMinima() :
+            MethodsPeriodicGaussian(params, period).findMinima();
         for(int i=0; i < minima.size(); i++) {
             double val = periodicGaussianMixture(params, minima[i], period);
             if(val < partitionCutoff_) {
@@ -91,8 +231,9 @@ vector<double> PartitionerEM::findLowMinima() const {
             }
         }
     } else {
-        MethodsGaussian mg(params);
-        vector<double> minima = mg.findMinima();
+        vector<double> minima = hasSeed_ ?
+            MethodsGaussian(params, Random::derive(seed_, 1)).findMinima() :
+            MethodsGaussian(params).findMinima();
         for(int i=0; i < minima.size(); i++) {
             double val = gaussianMixture(params, minima[i]);
             if(val < partitionCutoff_) {
@@ -121,6 +262,22 @@ int PartitionerEM::getInitialK() const {
 	return initialK_;
 }
 
+void PartitionerEM::setScreening(bool enabled) {
+	screening_ = enabled;
+}
+
+bool PartitionerEM::getScreening() const {
+	return screening_;
+}
+
+void PartitionerEM::setScreeningTolerance(double tolerance) {
+	screeningTolerance_ = tolerance;
+}
+
+double PartitionerEM::getScreeningTolerance() const {
+	return screeningTolerance_;
+}
+
 static bool compMean(const Param &a, const Param&b) {
 	return a.u < b.u;
 }
@@ -133,6 +290,9 @@ static bool compSig(const Param &a, const Param&b) {
 // if periodic, left and right are ignored.
 void PartitionerEM::evaluateModel(vector<double> &xvals, vector<double> &yvals, int nsamples) {
 
+	if(em_ == NULL || em_->getParams().size() == 0) {
+		throw(std::runtime_error("PartitionerEM::evaluateModel() - no model has been fitted"));
+	}
 	vector<Param> params = em_->getParams();
 
 	double left;
@@ -146,11 +306,11 @@ void PartitionerEM::evaluateModel(vector<double> &xvals, vector<double> &yvals,
 		vector<Param>::const_iterator max_mean = max_element(params.begin(), params.end(), compMean);
 		vector<Param>::const_iterator max_sig  = max_element(params.begin(), params.end(), compSig);
 
-		double left = min_mean->u;
+		left = min_mean->u;
 		while(gaussianMixture(params, left) > 1e-2) {
 			left -= 3 * max_sig->s;
 		}
-		double right = max_mean->u;
+		right = max_mean->u;
 		while(gaussianMixture(params, right) > 1e-2) {
 			right += 3* max_sig->s;
 		}
@@ -0,0 +1,264 @@
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+
+#include "TreeFile.h"
+#include "Buckets.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace Terran {
+
+const unsigned int TreeFile::VERSION;
+const unsigned int TreeFile::HAS_PERMUTATION;
+const int TreeFile::QUEUED;
+
+TreeFile::TreeFile(const string &filename) :
+    data_(NULL),
+    size_(0),
+#ifdef _WIN32
+    file_(INVALID_HANDLE_VALUE),
+    mapping_(NULL),
+#endif
+    header_(NULL),
+    period_(NULL),
+    nodes_(NULL),
+    cutStarts_(NULL),
+    cuts_(NULL),
+    buckets_(NULL),
+    permutation_(NULL),
+    numClusters_(0) {
+
+#ifdef _WIN32
+    file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file_ == INVALID_HANDLE_VALUE)
+        throw(std::runtime_error("TreeFile::TreeFile() - cannot open " + filename));
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file_, &size)) {
+        unmap();
+        throw(std::runtime_error("TreeFile::TreeFile() - cannot read the size of " + filename));
+    }
+    size_ = size.QuadPart;
+    if(size_ > 0) {
+        mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping_ != NULL)
+            data_ = (const char*) MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        if(data_ == NULL) {
+            unmap();
+            throw(std::runtime_error("TreeFile::TreeFile() - cannot map " + filename));
+        }
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw(std::runtime_error("TreeFile::TreeFile() - cannot open " + filename));
+    struct stat info;
+    if(fstat(fd, &info) != 0) {
+        close(fd);
+        throw(std::runtime_error("TreeFile::TreeFile() - cannot read the size of " + filename));
+    }
+    size_ = info.st_size;
+    if(size_ > 0) {
+        void* ptr = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if(ptr == MAP_FAILED) {
+            close(fd);
+            throw(std::runtime_error("TreeFile::TreeFile() - cannot map " + filename));
+        }
+        data_ = (const char*) ptr;
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+#endif
+
+    try {
+        if(size_ < sizeof(TreeFileHeader))
+            throw(std::runtime_error("TreeFile::TreeFile() - file is too small"));
+        header_ = (const TreeFileHeader*) data_;
+        if(memcmp(header_->magic, "TRRN", 4) != 0)
+            throw(std::runtime_error("TreeFile::TreeFile() - not a tree file"));
+        if(header_->byteOrder != 0x01020304)
+            throw(std::runtime_error("TreeFile::TreeFile() - file was written with a different byte order"));
+        if(header_->version != VERSION)
+            throw(std::runtime_error("TreeFile::TreeFile() - unsupported version"));
+
+        const unsigned long long D = header_->numDimensions;
+        const unsigned long long numNodes = header_->numNodes;
+        const unsigned long long N = header_->numPoints;
+        if(numNodes == 0 || N > 0x7fffffff)
+            throw(std::runtime_error("TreeFile::TreeFile() - file is corrupt"));
+        // every section must lie inside the file and be aligned for its type.
+        // The counts come from the file, so each is compared with the number
+        // of items the file could hold before it is multiplied by their size.
+        struct Section {
+            unsigned long long offset;
+            unsigned long long count;
+            unsigned long long itemSize;
+        } sections[6] = {
+            {header_->periodOffset, D, sizeof(int)},
+            {header_->nodesOffset, numNodes, sizeof(TreeFileNode)},
+            {header_->cutStartsOffset, numNodes*D+1, sizeof(unsigned long long)},
+            {header_->cutsOffset, header_->numCuts, sizeof(double)},
+            {header_->bucketsOffset, numNodes*D, sizeof(int)},
+            {header_->permutationOffset, hasPermutation() ? N : 0, sizeof(int)}
+        };
+        for(int i=0; i < 6; i++) {
+            const Section &section = sections[i];
+            if(section.offset % 8 != 0 || section.offset > size_ || section.count > (size_-section.offset)/section.itemSize)
+                throw(std::runtime_error("TreeFile::TreeFile() - file is truncated or corrupt"));
+        }
+
+        period_ = (const int*) (data_+header_->periodOffset);
+        nodes_ = (const TreeFileNode*) (data_+header_->nodesOffset);
+        cutStarts_ = (const unsigned long long*) (data_+header_->cutStartsOffset);
+        cuts_ = (const double*) (data_+header_->cutsOffset);
+        buckets_ = (const int*) (data_+header_->bucketsOffset);
+        if(hasPermutation())
+            permutation_ = (const int*) (data_+header_->permutationOffset);
+
+        if(cutStarts_[0] != 0 || cutStarts_[numNodes*D] != header_->numCuts)
+            throw(std::runtime_error("TreeFile::TreeFile() - bad cut offsets"));
+        for(unsigned long long i=0; i < numNodes*D; i++) {
+            if(cutStarts_[i+1] < cutStarts_[i])
+                throw(std::runtime_error("TreeFile::TreeFile() - bad cut offsets"));
+        }
+        // children come after their parent, so walking down always ends
+        for(int i=0; i < numNodes; i++) {
+            const TreeFileNode &node = nodes_[i];
+            if(node.begin < 0 || node.end < node.begin || node.end > N)
+                throw(std::runtime_error("TreeFile::TreeFile() - bad node range"));
+            if(node.numChildren < 0 || (node.numChildren > 0 && (node.firstChild <= i || node.firstChild > numNodes-node.numChildren)))
+                throw(std::runtime_error("TreeFile::TreeFile() - bad node children"));
+            if(node.numChildren == 0)
+                numClusters_++;
+        }
+        for(int i=0; i < numNodes; i++) {
+            const int leaf = nodes_[i].leaf;
+            if(nodes_[i].numChildren == 0 ? (leaf < 0 || leaf >= numClusters_) : leaf != -1)
+                throw(std::runtime_error("TreeFile::TreeFile() - bad leaf number"));
+        }
+    } catch(...) {
+        unmap();
+        throw;
+    }
+}
+
+TreeFile::~TreeFile() {
+    unmap();
+}
+
+void TreeFile::unmap() {
+#ifdef _WIN32
+    if(data_ != NULL)
+        UnmapViewOfFile(data_);
+    if(mapping_ != NULL)
+        CloseHandle(mapping_);
+    if(file_ != INVALID_HANDLE_VALUE)
+        CloseHandle(file_);
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if(data_ != NULL)
+        munmap((void*) data_, size_);
+#endif
+    data_ = NULL;
+}
+
+int TreeFile::getNumDimensions() const {
+    return header_->numDimensions;
+}
+
+int TreeFile::getNumNodes() const {
+    return header_->numNodes;
+}
+
+int TreeFile::getNumPoints() const {
+    return header_->numPoints;
+}
+
+int TreeFile::getNumClusters() const {
+    return numClusters_;
+}
+
+bool TreeFile::isPeriodic(int d) const {
+    return period_[d] != 0;
+}
+
+const TreeFileNode& TreeFile::getNode(int i) const {
+    return nodes_[i];
+}
+
+const double* TreeFile::getCuts(int i, int d, int &count) const {
+    const unsigned long long k = (unsigned long long) i*getNumDimensions()+d;
+    count = cutStarts_[k+1]-cutStarts_[k];
+    return cuts_+cutStarts_[k];
+}
+
+const int* TreeFile::getBuckets(int i) const {
+    return buckets_+(size_t) i*getNumDimensions();
+}
+
+bool TreeFile::hasPermutation() const {
+    return (header_->flags & HAS_PERMUTATION) != 0;
+}
+
+const int* TreeFile::getPermutation() const {
+    return permutation_;
+}
+
+// the children of a node are sorted by their bucket tuples, so the child
+// holding a cell is found by binary search. Empty cells go to the nearest child.
+int TreeFile::classify(const double* point) const {
+    const int D = getNumDimensions();
+    int buckets[64];
+    int* tuple = D <= 64 ? buckets : new int[D];
+    int i = 0;
+    while(nodes_[i].numChildren > 0) {
+        for(int d=0; d < D; d++) {
+            int count;
+            const double* cuts = getCuts(i, d, count);
+            tuple[d] = findBucket(point[d], cuts, count, isPeriodic(d));
+        }
+        const TreeFileNode &node = nodes_[i];
+        int low = node.firstChild;
+        int high = node.firstChild+node.numChildren;
+        while(low < high) {
+            const int middle = (low+high)/2;
+            if(lexicographical_compare(getBuckets(middle), getBuckets(middle)+D, tuple, tuple+D))
+                low = middle+1;
+            else
+                high = middle;
+        }
+        if(low == node.firstChild+node.numChildren || !equal(tuple, tuple+D, getBuckets(low))) {
+            // a cell that held no points, see bucketDistance()
+            int bestDistance = -1;
+            for(int k=node.firstChild; k < node.firstChild+node.numChildren; k++) {
+                int distance = 0;
+                for(int d=0; d < D; d++) {
+                    int count;
+                    getCuts(i, d, count);
+                    distance += bucketDistance(getBuckets(k)[d], tuple[d], count, isPeriodic(d));
+                }
+                if(bestDistance < 0 || distance < bestDistance) {
+                    low = k;
+                    bestDistance = distance;
+                }
+            }
+        }
+        i = low;
+    }
+    const int leaf = nodes_[i].leaf;
+    if(tuple != buckets)
+        delete[] tuple;
+    return leaf;
+}
+
+}
@@ -3,6 +3,10 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <map>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <Terran.h>
 
@@ -106,9 +110,247 @@ void testEasyCase2D() {
     Util::matchPeriodicPoints(truthPartition1, testPartitions[1], 2*PI, truthPartition1Errors);
 }
 
+// every dimension must be subsampled at the same distinct rows
+void testSubsample() {
+    vector<vector<double> > dataset;
+    for(int i=0; i < 10000; i++) {
+        vector<double> point(2);
+        point[0] = i;
+        point[1] = -i;
+        dataset.push_back(point);
+    }
+    Cluster cc(dataset, vector<int>(2, false));
+    if(cc.getSubsampleCount() != 3000)
+        throw(std::runtime_error("testSubsample() - wrong default subsample count"));
+    cc.setSubsampleCount(2500);
+    vector<double> x = cc.getDimension(0);
+    vector<double> y = cc.getDimension(1);
+    if(x.size() != 2500 || y.size() != 2500)
+        throw(std::runtime_error("testSubsample() - wrong subsample size"));
+    for(int i=0; i < x.size(); i++) {
+        if(x[i] != -y[i])
+            throw(std::runtime_error("testSubsample() - dimensions sampled at different rows"));
+    }
+    sort(x.begin(), x.end());
+    if(unique(x.begin(), x.end()) != x.end())
+        throw(std::runtime_error("testSubsample() - repeated rows in subsample"));
+
+    cc.setSubsampleCount(10000);
+    if(cc.getDimension(0).size() != 10000)
+        throw(std::runtime_error("testSubsample() - full subsample has wrong size"));
+    try {
+        cc.setSubsampleCount(10001);
+    } catch(const std::exception &e) {
+        return;
+    }
+    throw(std::runtime_error("testSubsample() - subsample count larger than the cluster accepted"));
+}
+
+// a view over some rows must behave like a cluster built from a copy of them
+void testView() {
+    vector<vector<double> > dataset;
+    for(int i=0; i < 5000; i++) {
+        vector<double> point(2);
+        point[0] = gaussianSample(i % 2 ? -3 : 3, 0.5);
+        point[1] = periodicGaussianSample(i % 3 ? -2 : 1, 0.4, 2*PI);
+        dataset.push_back(point);
+    }
+    vector<int> periodset(2);
+    periodset[1] = true;
+    vector<int> rows;
+    vector<vector<double> > subset;
+    for(int i=0; i < dataset.size(); i += 3) {
+        rows.push_back(i);
+        subset.push_back(dataset[i]);
+    }
+    Dataset data(dataset, periodset);
+    Cluster view(data, &rows[0], rows.size());
+    Cluster copy(subset, periodset);
+    if(view.getNumPoints() != copy.getNumPoints())
+        throw(std::runtime_error("testView() - wrong number of points"));
+    for(int n=0; n < view.getNumPoints(); n++) {
+        if(view.getPoint(n) != copy.getPoint(n))
+            throw(std::runtime_error("testView() - wrong point"));
+    }
+    vector<double> cuts0(1, 0.0);
+    vector<double> cuts1(1, -0.5);
+    cuts1.push_back(2.5);
+    view.setPartition(0, cuts0);
+    view.setPartition(1, cuts1);
+    copy.setPartition(0, cuts0);
+    copy.setPartition(1, cuts1);
+    if(view.assign() != copy.assign())
+        throw(std::runtime_error("testView() - view and copy assign differently"));
+
+    // all points of a row-major buffer read in place
+    vector<double> buffer;
+    for(int i=0; i < dataset.size(); i++) {
+        buffer.insert(buffer.end(), dataset[i].begin(), dataset[i].end());
+    }
+    Dataset rowMajor(&buffer[0], dataset.size(), 2, 2, 1, periodset);
+    Cluster strided(rowMajor, NULL, rowMajor.getNumPoints());
+    Cluster full(data, NULL, data.getNumPoints());
+    strided.setPartition(0, cuts0);
+    strided.setPartition(1, cuts1);
+    full.setPartition(0, cuts0);
+    full.setPartition(1, cuts1);
+    if(strided.assign() != full.assign())
+        throw(std::runtime_error("testView() - strided view assigns differently"));
+}
+
+// reference assignment: group the bucket tuples of each point with a map
+static vector<int> referenceAssign(const vector<vector<double> > &dataset, const vector<int> &periodset,
+    const vector<vector<double> > &cuts) {
+    map<vector<short>, int> labels;
+    vector<vector<short> > buckets(dataset.size(), vector<short>(periodset.size()));
+    for(int n=0; n < dataset.size(); n++) {
+        for(int d=0; d < periodset.size(); d++) {
+            int b = upper_bound(cuts[d].begin(), cuts[d].end(), dataset[n][d])-cuts[d].begin();
+            if(periodset[d] && b == cuts[d].size())
+                b = 0;
+            buckets[n][d] = b;
+        }
+        labels[buckets[n]] = 0;
+    }
+    int clusterIndex = 0;
+    for(map<vector<short>, int>::iterator it = labels.begin(); it != labels.end(); it++) {
+        it->second = clusterIndex++;
+    }
+    vector<int> assignment(dataset.size());
+    for(int n=0; n < dataset.size(); n++) {
+        assignment[n] = labels[buckets[n]];
+    }
+    return assignment;
+}
+
+// the original linear scan of Cluster::findBucket()
+static int linearBucket(double x, const vector<double> &cuts, bool periodic) {
+    int bucket = 0;
+    for(int j=0; j<cuts.size(); j++) {
+        if(x < cuts[j]) {
+            bucket = j;
+            break;
+        }
+        if(periodic)
+            bucket = 0;
+        else
+            bucket = j+1;
+    }
+    return bucket;
+}
+
+// the block kernel must reproduce the linear scan for any number of cuts,
+// including points exactly on a cut and repeated cuts
+void testFindBuckets() {
+    for(int m=0; m < 40; m++) {
+        vector<double> cuts;
+        for(int j=0; j < m; j++) {
+            cuts.push_back(-PI+2*PI*rand()/(double)RAND_MAX);
+        }
+        if(m > 2)
+            cuts[1] = cuts[0];
+        sort(cuts.begin(), cuts.end());
+        vector<double> x;
+        for(int i=0; i < 1000; i++) {
+            x.push_back(-4+8*rand()/(double)RAND_MAX);
+        }
+        x.insert(x.end(), cuts.begin(), cuts.end());
+        vector<int> buckets(x.size());
+        for(int periodic=0; periodic < 2; periodic++) {
+            Cluster::findBuckets(&x[0], x.size(), cuts, periodic, &buckets[0]);
+            for(int i=0; i < x.size(); i++) {
+                if(buckets[i] != linearBucket(x[i], cuts, periodic))
+                    throw(std::runtime_error("testFindBuckets() - bucket does not match linear scan"));
+            }
+        }
+    }
+}
+
+// the counting, radix sort and overflow paths of assign() must all agree with
+// the reference, for any number of threads
+void testAssignCodes(int numPoints) {
+    const int dims[] = {3, 6, 24};
+    for(int t=0; t < 3; t++) {
+        const int D = dims[t];
+        vector<int> periodset(D);
+        vector<vector<double> > cuts(D);
+        for(int d=0; d < D; d++) {
+            periodset[d] = d % 2;
+            for(int j=0; j < 15; j++) {
+                cuts[d].push_back(-PI+2*PI*rand()/(double)RAND_MAX);
+            }
+            sort(cuts[d].begin(), cuts[d].end());
+        }
+        // a dimension with no cuts at all
+        cuts[0].clear();
+        vector<vector<double> > dataset(numPoints, vector<double>(D));
+        for(int n=0; n < dataset.size(); n++) {
+            for(int d=0; d < D; d++) {
+                dataset[n][d] = -PI+2*PI*rand()/(double)RAND_MAX;
+            }
+        }
+        Cluster cc(dataset, periodset);
+        for(int d=0; d < D; d++) {
+            cc.setPartition(d, cuts[d]);
+        }
+        vector<int> reference = referenceAssign(dataset, periodset, cuts);
+#ifdef _OPENMP
+        const int threads[] = {1, 3, 4};
+        const int maxThreads = omp_get_max_threads();
+        for(int i=0; i < 3; i++) {
+            omp_set_num_threads(threads[i]);
+            if(cc.assign() != reference)
+                throw(std::runtime_error("testAssignCodes() - assignment does not match reference"));
+        }
+        omp_set_num_threads(maxThreads);
+#else
+        if(cc.assign() != reference)
+            throw(std::runtime_error("testAssignCodes() - assignment does not match reference"));
+#endif
+    }
+}
+
+// two of six dimensions are bimodal, one split is enough
+void testGreedy() {
+    vector<vector<double> > dataset;
+    for(int i=0; i < 6000; i++) {
+        vector<double> point(6);
+        for(int d=0; d < 6; d++) {
+            point[d] = gaussianSample(0, 1);
+        }
+        point[2] = gaussianSample(i % 2 ? -4 : 4, 0.7);
+        point[4] = gaussianSample(i % 3 ? -4 : 4, 0.7);
+        dataset.push_back(point);
+    }
+    vector<int> periodset(6, 0);
+    Cluster cluster(dataset, periodset);
+    cluster.partitionGreedy(1);
+    int split = 0;
+    for(int d=0; d < 6; d++) {
+        if(cluster.getPartition(d).size() > 0) {
+            if(d != 2 && d != 4)
+                throw(std::runtime_error("testGreedy() - split along a unimodal dimension"));
+            split++;
+        }
+    }
+    if(split != 1)
+        throw(std::runtime_error("testGreedy() - expected exactly one split"));
+    if(cluster.getIterations() == 0)
+        throw(std::runtime_error("testGreedy() - no iterations counted"));
+    vector<int> assignment = cluster.assign();
+    if(*max_element(assignment.begin(), assignment.end()) != 1)
+        throw(std::runtime_error("testGreedy() - expected two clusters"));
+}
+
 int main() {
     try{
         testEasyCase2D();
+        testFindBuckets();
+        testAssignCodes(5000);
+        testAssignCodes(100000);
+        testView();
+        testSubsample();
+        testGreedy();
         cout << "done" << endl;
     } catch(const exception &e) {
         cout << e.what();
@@ -1,12 +1,20 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <limits>
+#include <iterator>
+#include <string.h>
+#include <stddef.h>
 
 #include <Terran.h>
 #include "util.h"
 
 #include <sstream>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace Terran;
 using namespace std;
 
@@ -189,6 +197,421 @@ void testPeriodicMultiCluster() {
 
 }
 
+// build() partitions nodes concurrently but must find the same tree as the
+// serial loop
+static vector<vector<double> > fourClusters() {
+    double period = 2*PI;
+    vector<vector<double> > dataset;
+    const double means[4][2] = {{-2, 1.5}, {2.7, -1.5}, {0.4, -0.3}, {0, 2.8}};
+    for(int c=0; c < 4; c++) {
+        for(int i=0; i < 2000; i++) {
+            vector<double> point(2);
+            point[0] = periodicGaussianSample(means[c][0], 0.3, period);
+            point[1] = periodicGaussianSample(means[c][1], 0.4, period);
+            dataset.push_back(point);
+        }
+    }
+    return dataset;
+}
+
+void testBuild() {
+    vector<vector<double> > dataset = fourClusters();
+    vector<int> periodset(2,true);
+
+    srand(3);
+    ClusterTree serial(dataset, periodset);
+    while(serial.queueSize() > 0) {
+        serial.setCurrentCluster();
+        serial.getCurrentCluster().partitionAll();
+        serial.divideCurrentCluster(3000);
+    }
+
+#ifdef _OPENMP
+    omp_set_num_threads(4);
+#endif
+    srand(3);
+    ClusterTree parallel(dataset, periodset);
+    parallel.build();
+    if(parallel.queueSize() != 0)
+        throw(std::runtime_error("testBuild() - queue not empty"));
+    if(parallel.getNumClusters() != serial.getNumClusters() || parallel.assign() != serial.assign())
+        throw(std::runtime_error("testBuild() - build() and the serial loop differ"));
+    if(parallel.getNumClusters() < 4)
+        throw(std::runtime_error("testBuild() - too few clusters"));
+}
+
+// a budgeted build stops early with a valid tree, and resuming it gives the
+// same tree as an unlimited build
+void testBudget() {
+    vector<vector<double> > dataset = fourClusters();
+    vector<int> periodset(2,true);
+
+    srand(5);
+    ClusterTree full(dataset, periodset);
+    full.setMinSplitSize(500);
+    full.build();
+
+    for(int i=0; i < 2; i++) {
+        srand(5);
+        ClusterTree partial(dataset, periodset);
+        partial.setMinSplitSize(500);
+        ClusterTree::Budget budget;
+        if(i == 0)
+            budget.nodes = 1;
+        else
+            budget.iterations = 1;
+        budget.priority = ClusterTree::HIGHEST_VARIANCE_FIRST;
+        if(partial.build(budget) || partial.queueSize() == 0)
+            throw(std::runtime_error("testBudget() - budget was ignored"));
+        vector<int> assignment = partial.assign();
+        if(partial.getNumClusters() < 2 || *max_element(assignment.begin(), assignment.end()) != partial.getNumClusters()-1)
+            throw(std::runtime_error("testBudget() - invalid partial tree"));
+        if(!partial.build())
+            throw(std::runtime_error("testBudget() - queue not emptied"));
+        if(partial.assign() != full.assign())
+            throw(std::runtime_error("testBudget() - resumed build differs"));
+    }
+}
+
+// a saved tree classifies the points it was built on into their clusters,
+// and a checkpoint of a budgeted build resumes into the full tree
+void testSave() {
+    vector<vector<double> > dataset = fourClusters();
+    vector<int> periodset(2,true);
+    const string filename = "testClusterTree.tree";
+
+    srand(7);
+    ClusterTree full(dataset, periodset);
+    full.setMinSplitSize(500);
+    full.build();
+    full.save(filename, false);
+    {
+        TreeFile file(filename);
+        if(file.hasPermutation() || file.getNumClusters() != full.getNumClusters())
+            throw(std::runtime_error("testSave() - bad header"));
+        vector<int> assignment = full.assign();
+        for(int n=0; n < dataset.size(); n++) {
+            if(file.classify(&dataset[n][0]) != assignment[n])
+                throw(std::runtime_error("testSave() - classify() differs from assign()"));
+        }
+    }
+    bool resumed = true;
+    try {
+        ClusterTree tree(Dataset(dataset, periodset), filename);
+    } catch(const std::exception &e) {
+        resumed = false;
+    }
+    if(resumed)
+        throw(std::runtime_error("testSave() - resumed without a permutation"));
+
+    srand(7);
+    ClusterTree partial(dataset, periodset);
+    partial.setMinSplitSize(500);
+    ClusterTree::Budget budget;
+    budget.nodes = 1;
+    partial.build(budget);
+    partial.save(filename);
+    ClusterTree checkpoint(Dataset(dataset, periodset), filename);
+    if(checkpoint.queueSize() != partial.queueSize() || checkpoint.assign() != partial.assign())
+        throw(std::runtime_error("testSave() - checkpoint differs"));
+    checkpoint.setMinSplitSize(500);
+    checkpoint.build();
+    if(checkpoint.assign() != full.assign())
+        throw(std::runtime_error("testSave() - resumed build differs"));
+    remove(filename.c_str());
+}
+
+// a compiled tree labels the points of the dataset as assign() does, whether
+// its nodes are tabulated or searched, and agrees with a saved tree elsewhere
+void testCompile() {
+    vector<vector<double> > dataset = fourClusters();
+    vector<int> periodset(2,true);
+
+    srand(9);
+    ClusterTree tree(dataset, periodset);
+    tree.setMinSplitSize(500);
+    tree.build();
+    CompiledTree compiled = tree.compile();
+    if(compiled.getNumClusters() != tree.getNumClusters() || compiled.getNumDimensions() != 2)
+        throw(std::runtime_error("testCompile() - bad shape"));
+
+    vector<double> points;
+    vector<float> floats;
+    for(int n=0; n < dataset.size(); n++) {
+        points.insert(points.end(), dataset[n].begin(), dataset[n].end());
+    }
+    vector<int> clusters(dataset.size());
+    compiled.classify(&points[0], dataset.size(), &clusters[0]);
+    if(clusters != tree.assign())
+        throw(std::runtime_error("testCompile() - classify() differs from assign()"));
+
+    const string filename = "testCompile.tree";
+    tree.save(filename, false);
+    TreeFile file(filename);
+    points.resize(0);
+    for(int n=0; n < 5000; n++) {
+        floats.push_back(2*PI*rand()/RAND_MAX-PI);
+        points.push_back(floats.back());
+    }
+    vector<int> fromFloats(points.size()/2);
+    clusters.resize(points.size()/2);
+    compiled.classify(&points[0], clusters.size(), &clusters[0]);
+    compiled.classify(&floats[0], fromFloats.size(), &fromFloats[0]);
+    for(int n=0; n < clusters.size(); n++) {
+        if(clusters[n] != file.classify(&points[2*n]) || clusters[n] != compiled.classify(&points[2*n]) || clusters[n] != fromFloats[n])
+            throw(std::runtime_error("testCompile() - classifiers disagree"));
+    }
+    // datasets are read in place, column-major and strided alike
+    vector<float> columns(floats.size());
+    for(int n=0; n < clusters.size(); n++) {
+        columns[n] = floats[2*n];
+        columns[clusters.size()+n] = floats[2*n+1];
+    }
+    vector<int> fromColumns(clusters.size());
+    vector<int> fromRows(clusters.size());
+    compiled.classify(Dataset(&columns[0], clusters.size(), 2, 1, clusters.size(), periodset), &fromColumns[0]);
+    compiled.classify(Dataset(&points[0], clusters.size(), 2, 2, 1, periodset), &fromRows[0]);
+    if(fromColumns != fromFloats || fromRows != clusters)
+        throw(std::runtime_error("testCompile() - dataset classify() disagrees"));
+    remove(filename.c_str());
+    // insert() routes points the same way, empty cells included
+    vector<vector<double> > random;
+    for(int n=0; n < clusters.size(); n++) {
+        random.push_back(vector<double>(points.begin()+2*n, points.begin()+2*n+2));
+    }
+    tree.setMinSplitSize(dataset.size()+random.size());
+    tree.insert(random);
+    vector<int> inserted = tree.assign();
+    if(!equal(clusters.begin(), clusters.end(), inserted.begin()+dataset.size()))
+        throw(std::runtime_error("testCompile() - insert() disagrees with classify()"));
+
+    // two clusters apart in every one of 13 dimensions give 2^13 cells, too
+    // many to tabulate
+    const int D = 13;
+    vector<vector<double> > separated;
+    for(int i=0; i < 1000; i++) {
+        vector<double> point(D);
+        for(int d=0; d < D; d++) {
+            point[d] = gaussianSample(i % 2 ? 2 : -2, 0.3);
+        }
+        separated.push_back(point);
+    }
+    srand(9);
+    ClusterTree wide(separated, vector<int>(D, 0));
+    wide.setMinSplitSize(500);
+    wide.build();
+    CompiledTree searched = wide.compile();
+    vector<int> assignment = wide.assign();
+    for(int n=0; n < separated.size(); n++) {
+        if(searched.classify(&separated[n][0]) != assignment[n])
+            throw(std::runtime_error("testCompile() - searched node differs from assign()"));
+    }
+    // a point in an empty cell goes to the nearest child everywhere
+    vector<double> between(D, -2);
+    between[0] = 2;
+    const string filename2 = "testCompileWide.tree";
+    wide.save(filename2, false);
+    TreeFile wideFile(filename2);
+    if(wide.getNumClusters() != 2 || searched.classify(&between[0]) != assignment[0] || wideFile.classify(&between[0]) != assignment[0])
+        throw(std::runtime_error("testCompile() - empty cell did not go to the nearest child"));
+    remove(filename2.c_str());
+    wide.setMinSplitSize(separated.size());
+    wide.insert(vector<vector<double> >(1, between));
+    if(wide.assign().back() != assignment[0])
+        throw(std::runtime_error("testCompile() - insert() routed the empty cell elsewhere"));
+}
+
+// inserting points from a new cluster divides only the leaves they drift,
+// and the grown tree saves and resumes like a built one
+void testInsert() {
+    vector<vector<double> > all = fourClusters();
+    vector<int> periodset(2,true);
+    // the last cluster arrives later
+    vector<vector<double> > dataset(all.begin(), all.begin()+6000);
+    const double means[3][2] = {{-2, 1.5}, {2.7, -1.5}, {0.4, -0.3}};
+    vector<vector<double> > same;
+    for(int i=0; i < 1500; i++) {
+        vector<double> point(2);
+        point[0] = periodicGaussianSample(means[i%3][0], 0.3, 2*PI);
+        point[1] = periodicGaussianSample(means[i%3][1], 0.4, 2*PI);
+        same.push_back(point);
+    }
+    vector<vector<double> > fresh(all.begin()+6000, all.end());
+
+    srand(11);
+    ClusterTree tree(dataset, periodset);
+    tree.setMinSplitSize(500);
+    tree.build();
+    const int before = tree.getNumClusters();
+    tree.insert(same);
+    vector<int> assignment = tree.assign();
+    if(assignment.size() != 7500 || tree.getNumClusters() < before)
+        throw(std::runtime_error("testInsert() - bad assignment after insert"));
+
+    if(tree.insert(fresh) == 0)
+        throw(std::runtime_error("testInsert() - drift was not noticed"));
+    assignment = tree.assign();
+    if(assignment.size() != 9500 || *max_element(assignment.begin(), assignment.end()) != tree.getNumClusters()-1)
+        throw(std::runtime_error("testInsert() - bad assignment after drift"));
+    // the new points form clusters of their own
+    vector<char> old(tree.getNumClusters(), 0);
+    for(int n=0; n < 7500; n++) {
+        old[assignment[n]] = 1;
+    }
+    int mixed = 0;
+    for(int n=7500; n < 9500; n++) {
+        mixed += old[assignment[n]];
+    }
+    if(mixed > 200)
+        throw(std::runtime_error("testInsert() - new cluster was not separated"));
+
+    const string filename = "testInsert.tree";
+    tree.save(filename);
+    vector<vector<double> > grown(dataset);
+    grown.insert(grown.end(), same.begin(), same.end());
+    grown.insert(grown.end(), fresh.begin(), fresh.end());
+    ClusterTree resumed(Dataset(grown, periodset), filename);
+    if(resumed.assign() != assignment)
+        throw(std::runtime_error("testInsert() - saved tree differs"));
+    remove(filename.c_str());
+}
+
+// the root cuts of dimension d, each one exactly, the ends of the periodic interval,
+// infinities and NaN
+static vector<double> edgeValues(const TreeFile &file, int d) {
+    int count;
+    const double* cuts = file.getCuts(0, d, count);
+    vector<double> values(cuts, cuts+count);
+    values.push_back(PI);
+    values.push_back(-PI);
+    values.push_back(numeric_limits<double>::infinity());
+    values.push_back(-numeric_limits<double>::infinity());
+    values.push_back(numeric_limits<double>::quiet_NaN());
+    return values;
+}
+
+// a coordinate on a cut, at the ends of the periodic interval, infinite or NaN
+// falls into the same bucket through Cluster::findBuckets() and findBucket(),
+// and into the same cluster through TreeFile and CompiledTree
+static void checkEdges(const ClusterTree &tree, const string &filename) {
+    const int D = tree.getNumDimensions();
+    tree.save(filename, false);
+    TreeFile file(filename);
+    CompiledTree compiled = tree.compile();
+    for(int d=0; d < D; d++) {
+        int count;
+        const double* cuts = file.getCuts(0, d, count);
+        if(count == 0)
+            continue;
+        const bool periodic = file.isPeriodic(d);
+        vector<double> values = edgeValues(file, d);
+        vector<int> buckets(values.size());
+        Cluster::findBuckets(&values[0], values.size(), vector<double>(cuts, cuts+count), periodic, &buckets[0]);
+        for(int i=0; i < values.size(); i++) {
+            int expected;
+            if(i < count)
+                expected = i+1;
+            else if(values[i] != values[i] || values[i] == numeric_limits<double>::infinity())
+                expected = count;
+            else
+                expected = findBucket(values[i], cuts, count, false);
+            if(periodic && expected == count)
+                expected = 0;
+            if(buckets[i] != expected || findBucket(values[i], cuts, count, periodic) != expected) {
+                stringstream msg;
+                msg << "testBucketEdges() - " << values[i] << " is in bucket " << buckets[i] << " instead of " << expected;
+                throw(std::runtime_error(msg.str()));
+            }
+
+            vector<double> point(D, 0.1);
+            point[d] = values[i];
+            if(file.classify(&point[0]) != compiled.classify(&point[0]))
+                throw(std::runtime_error("testBucketEdges() - classifiers disagree"));
+        }
+    }
+    remove(filename.c_str());
+}
+
+void testBucketEdges() {
+    // the first and last of four periodic buckets are neighbours
+    if(bucketDistance(0, 3, 4, true) != 1 || bucketDistance(3, 0, 4, false) != 3 || bucketDistance(1, 3, 4, true) != 2)
+        throw(std::runtime_error("testBucketEdges() - wrong bucket distance"));
+    vector<vector<double> > dataset = fourClusters();
+    srand(9);
+    ClusterTree tree(dataset, vector<int>(2, true));
+    tree.setMinSplitSize(500);
+    tree.build();
+    checkEdges(tree, "testBucketEdges.tree");
+
+    // aperiodic, and too many cells to tabulate
+    const int D = 13;
+    vector<vector<double> > separated;
+    for(int i=0; i < 1000; i++) {
+        vector<double> point(D);
+        for(int d=0; d < D; d++) {
+            point[d] = gaussianSample(i % 2 ? 2 : -2, 0.3);
+        }
+        separated.push_back(point);
+    }
+    srand(9);
+    ClusterTree wide(separated, vector<int>(D, 0));
+    wide.setMinSplitSize(500);
+    wide.build();
+    checkEdges(wide, "testBucketEdges.tree");
+}
+
+// a tree draws its root seed from rand() and derives every other seed from
+// it, so building does not move the caller's rand() stream any further
+void testRandUntouched() {
+    vector<vector<double> > dataset = fourClusters();
+    srand(5);
+    rand();
+    rand();
+    const int expected = rand();
+    srand(5);
+    ClusterTree tree(dataset, vector<int>(2, true));
+    tree.setMinSplitSize(500);
+    tree.build();
+    if(tree.getNumClusters() < 2 || rand() != expected)
+        throw(std::runtime_error("testRandUntouched() - build() drew from rand()"));
+}
+
+// a header whose counts would wrap around when multiplied by their item size
+// is rejected before any section is read
+template<typename T> static void expectCorrupt(const string &bytes, size_t offset, T value) {
+    string corrupt(bytes);
+    memcpy(&corrupt[offset], &value, sizeof(T));
+    const string filename = "testCorruptHeader.tree";
+    ofstream(filename.c_str(), ios::binary).write(corrupt.data(), corrupt.size());
+    bool thrown = false;
+    try {
+        TreeFile file(filename);
+    } catch(const std::runtime_error &) {
+        thrown = true;
+    }
+    remove(filename.c_str());
+    if(!thrown)
+        throw(std::runtime_error("testCorruptHeader() - corrupt header was accepted"));
+}
+
+void testCorruptHeader() {
+    vector<vector<double> > dataset = fourClusters();
+    srand(9);
+    ClusterTree tree(dataset, vector<int>(2, true));
+    tree.setMinSplitSize(500);
+    tree.build();
+    const string filename = "testCorruptHeader.tree";
+    tree.save(filename);
+    ifstream in(filename.c_str(), ios::binary);
+    const string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+    const TreeFileHeader header = *(const TreeFileHeader*) bytes.data();
+    expectCorrupt(bytes, offsetof(TreeFileHeader, numDimensions), 0xffffffffu);
+    expectCorrupt(bytes, offsetof(TreeFileHeader, numNodes), 0xffffffffu);
+    expectCorrupt(bytes, offsetof(TreeFileHeader, numCuts), (1ULL << 61)+header.numCuts);
+    expectCorrupt(bytes, offsetof(TreeFileHeader, numPoints), (1ULL << 62)+header.numPoints);
+}
+
 int main() {
     try{
         cout << "testPeriodicSimpleCase()" << endl;
@@ -197,6 +620,22 @@ int main() {
         srand(1);
         cout << "testPeriodicMultiCluster()" << endl;
         testPeriodicMultiCluster();
+        cout << "testBuild()" << endl;
+        testBuild();
+        cout << "testBudget()" << endl;
+        testBudget();
+        cout << "testSave()" << endl;
+        testSave();
+        cout << "testCompile()" << endl;
+        testCompile();
+        cout << "testInsert()" << endl;
+        testInsert();
+        cout << "testBucketEdges()" << endl;
+        testBucketEdges();
+        cout << "testRandUntouched()" << endl;
+        testRandUntouched();
+        cout << "testCorruptHeader()" << endl;
+        testCorruptHeader();
         //cout << "testNonPeriodicMultiCluster()" << endl;
         //srand(1);
         //testNonPeriodicMultiCluster();
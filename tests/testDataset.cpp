@@ -0,0 +1,199 @@
+// tests the column-major storage of Dataset
+
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+
+#include <Dataset.h>
+
+using namespace std;
+using namespace Terran;
+
+void testLayout() {
+    // odd sizes so that columns need padding
+    const int N = 13;
+    const int D = 3;
+    vector<vector<double> > points(N, vector<double>(D));
+    for(int n=0; n < N; n++) {
+        for(int d=0; d < D; d++) {
+            points[n][d] = n*10+d;
+        }
+    }
+    Dataset data(points);
+    if(data.getNumPoints() != N || data.getNumDimensions() != D)
+        throw(std::runtime_error("testLayout() - wrong size"));
+    for(int d=0; d < D; d++) {
+        const double *column = data.getColumn(d);
+        if(((size_t)column) % 64 != 0)
+            throw(std::runtime_error("testLayout() - column is not aligned"));
+        for(int n=0; n < N; n++) {
+            if(column[n] != points[n][d] || data(n,d) != points[n][d])
+                throw(std::runtime_error("testLayout() - wrong column value"));
+        }
+    }
+    for(int n=0; n < N; n++) {
+        if(data.getPoint(n) != points[n])
+            throw(std::runtime_error("testLayout() - wrong point"));
+    }
+
+    Dataset copy(data);
+    Dataset assigned(vector<vector<double> >(1, vector<double>(1)));
+    assigned = data;
+    for(int d=0; d < D; d++) {
+        for(int n=0; n < N; n++) {
+            if(copy(n,d) != points[n][d] || assigned(n,d) != points[n][d])
+                throw(std::runtime_error("testLayout() - bad copy"));
+        }
+    }
+}
+
+void testRagged() {
+    vector<vector<double> > points(2, vector<double>(2));
+    points[1].push_back(0);
+    try {
+        Dataset data(points);
+    } catch(const std::exception &e) {
+        return;
+    }
+    throw(std::runtime_error("testRagged() - ragged points were accepted"));
+}
+
+// periodic coordinates outside [-PI, PI] and bad period masks are rejected
+void testPeriod() {
+    vector<vector<double> > points(3, vector<double>(2, 0.5));
+    vector<int> period(2);
+    period[1] = 1;
+    Dataset data(points, period);
+    if(data.isPeriodic(0) || !data.isPeriodic(1))
+        throw(std::runtime_error("testPeriod() - wrong periodicity"));
+
+    vector<vector<vector<double> > > badPoints(3, points);
+    vector<vector<int> > badPeriods(3, period);
+    badPoints[0][2][1] = 3.5;
+    badPeriods[1][0] = 2;
+    badPeriods[2].push_back(0);
+    for(int i=0; i < 3; i++) {
+        bool thrown = false;
+        try {
+            Dataset bad(badPoints[i], badPeriods[i]);
+        } catch(const std::exception &e) {
+            thrown = true;
+        }
+        if(!thrown)
+            throw(std::runtime_error("testPeriod() - invalid dataset accepted"));
+    }
+}
+
+// views read caller memory in place for any layout and element type
+void testView() {
+    const int N = 11;
+    const int D = 3;
+    vector<int> period(D);
+    period[2] = 1;
+    // row-major with one padding element per row
+    const size_t rowStride = D+1;
+    vector<double> doubles(N*rowStride, 100);
+    vector<float> floats(N*rowStride, 100);
+    vector<double> columns(D*N);
+    for(int n=0; n < N; n++) {
+        for(int d=0; d < D; d++) {
+            const double value = d == 2 ? 0.25*(n-5) : n*10+d;
+            doubles[n*rowStride+d] = value;
+            floats[n*rowStride+d] = value;
+            columns[d*N+n] = value;
+        }
+    }
+    Dataset rowMajor(&doubles[0], N, D, rowStride, 1, period);
+    Dataset rowMajorFloat(&floats[0], N, D, rowStride, 1, period);
+    Dataset columnMajor(&columns[0], N, D, 1, N, period);
+    if(rowMajor.getColumn(0) != NULL || rowMajorFloat.getColumn(0) != NULL)
+        throw(std::runtime_error("testView() - strided view has a column"));
+    if(columnMajor.getColumn(1) != &columns[N])
+        throw(std::runtime_error("testView() - column-major view was copied"));
+
+    Dataset copy(rowMajorFloat);
+    vector<int> rows(N);
+    for(int n=0; n < N; n++) {
+        rows[n] = N-1-n;
+    }
+    vector<double> a(N), b(N), c(N);
+    for(int d=0; d < D; d++) {
+        rowMajor.gather(d, 0, N, &a[0]);
+        copy.gather(d, 0, N, &b[0]);
+        columnMajor.gather(d, &rows[0], N, &c[0]);
+        for(int n=0; n < N; n++) {
+            const double value = columns[d*N+n];
+            if(rowMajor(n,d) != value || rowMajorFloat(n,d) != value || columnMajor(n,d) != value)
+                throw(std::runtime_error("testView() - wrong value"));
+            if(a[n] != value || b[n] != value || c[N-1-n] != value)
+                throw(std::runtime_error("testView() - wrong gathered value"));
+        }
+    }
+
+    // views are validated like copies
+    floats[4*rowStride+2] = 4;
+    bool thrown = false;
+    try {
+        Dataset bad(&floats[0], N, D, rowStride, 1, period);
+    } catch(const std::exception &e) {
+        thrown = true;
+    }
+    if(!thrown)
+        throw(std::runtime_error("testView() - invalid view accepted"));
+}
+
+// appending copies a view into owned storage and grows it in place
+void testAppend() {
+    const int N = 5;
+    vector<int> period(2);
+    period[1] = 1;
+    vector<float> floats(2*N);
+    for(int n=0; n < N; n++) {
+        floats[2*n] = n;
+        floats[2*n+1] = 0.25*n-1;
+    }
+    Dataset data(&floats[0], N, 2, 2, 1, period);
+    for(int n=N; n < 200; n++) {
+        vector<vector<double> > points(1, vector<double>(2));
+        points[0][0] = n;
+        points[0][1] = 0.25*(n%10)-1;
+        data.append(points);
+    }
+    floats[0] = -1;
+    Dataset copy(data);
+    if(data.getNumPoints() != 200 || copy.getNumPoints() != 200)
+        throw(std::runtime_error("testAppend() - wrong number of points"));
+    for(int d=0; d < 2; d++) {
+        if(data.getColumn(d) == NULL || (size_t) data.getColumn(d) % 64 != 0 || (size_t) copy.getColumn(d) % 64 != 0)
+            throw(std::runtime_error("testAppend() - columns are not aligned"));
+    }
+    for(int n=0; n < 200; n++) {
+        if(data(n,0) != n || copy(n,0) != n || data(n,1) != 0.25*(n%10)-1 || copy(n,1) != data(n,1))
+            throw(std::runtime_error("testAppend() - wrong value"));
+    }
+
+    vector<vector<double> > bad(2, vector<double>(2, 0));
+    bad[1][1] = 4;
+    bool thrown = false;
+    try {
+        data.append(bad);
+    } catch(const std::exception &e) {
+        thrown = true;
+    }
+    if(!thrown || data.getNumPoints() != 200)
+        throw(std::runtime_error("testAppend() - invalid points appended"));
+}
+
+int main() {
+    try {
+        testLayout();
+        testRagged();
+        testPeriod();
+        testView();
+        testAppend();
+        cout << "done" << endl;
+    } catch(const exception &e) {
+        cout << e.what() << endl;
+    }
+}
@@ -148,6 +148,63 @@ void testUniSpecial() {
 	Util::matchPoints(maxima, trueMaxima, 0.3);
 }
 
+// windowed E/M steps must agree with an effectively dense run
+void testCutoff() {
+    vector<Param> trueParams(2);
+    trueParams[0].p = 0.4;
+    trueParams[0].u = -3.4;
+    trueParams[0].s = 1.2;
+    trueParams[1].p = 0.6;
+    trueParams[1].u = 7.4;
+    trueParams[1].s = 2.2;
+    vector<double> data;
+	for(int i=0; i < 5000; i++) {
+		data.push_back(gaussianMixtureSample(trueParams));
+	}
+    vector<Param> params;
+    params.push_back(Param(0.5, -1.0, 2.0));
+    params.push_back(Param(0.5,  5.0, 2.0));
+
+    EMGaussian sparse(data, params);
+    sparse.run();
+    EMGaussian dense(data, params);
+    dense.setCutoff(1e6);
+    dense.run();
+
+    Util::matchParameters(dense.getParams(), sparse.getParams(), 1e-6);
+}
+
+// an EM object moved onto new data must fit it like a freshly constructed one
+void testSetData() {
+    vector<Param> trueParams(2);
+    trueParams[0] = Param(0.3, -2.0, 0.7);
+    trueParams[1] = Param(0.7, 4.0, 1.5);
+    vector<double> first, second;
+	for(int i=0; i < 3000; i++) {
+		first.push_back(gaussianSample(1.0, 3.0));
+	}
+	for(int i=0; i < 6000; i++) {
+		second.push_back(gaussianMixtureSample(trueParams));
+	}
+    vector<Param> params;
+    params.push_back(Param(0.5, -1.0, 2.0));
+    params.push_back(Param(0.5,  2.0, 2.0));
+
+    EMGaussian reused(first);
+    reused.setMaxSteps(3);
+    reused.simpleRun(10);
+    reused.setData(second);
+    reused.reset();
+    if(reused.getDataSize() != second.size() || reused.getParams().size() != 0)
+        throw(std::runtime_error("testSetData() - setData() and reset() did not take effect"));
+    reused.setParameters(params);
+    reused.run();
+
+    EMGaussian fresh(second, params);
+    fresh.run();
+    Util::matchParameters(fresh.getParams(), reused.getParams(), 1e-12);
+}
+
 int main() {
     try	{
 		cout << "testUniSpecial()" << endl;
@@ -161,6 +218,12 @@ int main() {
         cout << "testBimodalGaussian()" << endl;
 		srand(1);
         testBimodalGaussian();
+		cout << "testSetData()" << endl;
+		srand(1);
+        testSetData();
+		cout << "testCutoff()" << endl;
+		srand(1);
+        testCutoff();
     } catch( const std::exception &e ) {
         cout << e.what() << endl;
     }
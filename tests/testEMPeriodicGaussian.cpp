@@ -129,12 +129,75 @@ void testBimodalPeriodicGaussian() {
     }
 }
 
+// windowed E/M steps must agree with an effectively dense run
+void testCutoff() {
+    double period = 2*PI;
+    vector<double> data;
+    for(int i=0; i < 3000; i++) {
+        data.push_back(periodicGaussianSample(2.9, 0.4, period));
+        data.push_back(periodicGaussianSample(-0.5, 0.6, period));
+    }
+    vector<Param> params;
+    params.push_back(Param(0.5, 2.0, 0.8));
+    params.push_back(Param(0.5, -1.0, 0.8));
+
+    EMPeriodicGaussian sparse(data, params, period);
+    sparse.run();
+    EMPeriodicGaussian dense(data, params, period);
+    dense.setCutoff(1e6);
+    dense.run();
+
+    Util::matchParameters(dense.getParams(), sparse.getParams(), 1e-6);
+}
+
+// E/M steps split into tasks must give the same fit as a serial run
+void testTasks() {
+    double period = 2*PI;
+    vector<double> data;
+    for(int i=0; i < 5000; i++) {
+        data.push_back(periodicGaussianSample(2.9, 0.4, period));
+        data.push_back(periodicGaussianSample(-0.5, 0.6, period));
+    }
+    vector<Param> params;
+    for(int i=0; i < 12; i++) {
+        params.push_back(Param(1.0/12, -PI+i*period/12, 0.3));
+    }
+
+    EMPeriodicGaussian serial(data, params, period);
+    serial.run();
+    double serialLikelihood = serial.getLikelihood();
+
+    EMPeriodicGaussian tasked(data, params, period);
+    double taskedLikelihood = 0;
+    #pragma omp parallel num_threads(4)
+    #pragma omp single
+    {
+        tasked.run();
+        taskedLikelihood = tasked.getLikelihood();
+    }
+
+    vector<Param> serialParams = serial.getParams();
+    vector<Param> taskedParams = tasked.getParams();
+    if(serialParams.size() != taskedParams.size())
+        throw(std::runtime_error("testTasks() - number of components depends on the number of threads"));
+    for(int i=0; i < serialParams.size(); i++) {
+        if(serialParams[i].p != taskedParams[i].p || serialParams[i].u != taskedParams[i].u || serialParams[i].s != taskedParams[i].s)
+            throw(std::runtime_error("testTasks() - parameters depend on the number of threads"));
+    }
+    if(serialLikelihood != taskedLikelihood)
+        throw(std::runtime_error("testTasks() - likelihood depends on the number of threads"));
+}
+
 int main() {
     try {
         srand(1);
         testUnimodalPeriodicGaussian();
         srand(1);
         testBimodalPeriodicGaussian();
+        srand(1);
+        testTasks();
+        srand(1);
+        testCutoff();
     } catch( const std::exception &e ) {
         cout << e.what() << endl;
     }
@@ -0,0 +1,134 @@
+// tests the fast exp approximation and its effect on cut locations
+
+#include <math.h>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <FastMath.h>
+#include <MathFunctions.h>
+#include <EMGaussian.h>
+#include <EMPeriodicGaussian.h>
+#include <MethodsGaussian.h>
+#include <MethodsPeriodicGaussian.h>
+
+#include "util.h"
+
+using namespace std;
+using namespace Terran;
+
+template<FastMathAccuracy A> void testExpAccuracy(double bound) {
+    double worst = 0;
+    for(double x = -700; x < 700; x += 0.0137) {
+        double truth = exp(x);
+        worst = max(worst, fabs(fastExp<A>(x)-truth)/truth);
+    }
+    if(worst > bound) {
+        stringstream msg;
+        msg << "testExpAccuracy() - relative error " << worst << " exceeds " << bound;
+        throw(std::runtime_error(msg.str()));
+    }
+    // the tails of a gaussian must still vanish
+    if(fastExp<A>(-708.5) != 0 || fastExp<A>(-1e300) != 0)
+        throw(std::runtime_error("testExpAccuracy() - exp does not underflow to 0"));
+}
+
+// the cuts PartitionerEM would find with em: a seeded simpleRun() and the
+// minima of the fitted mixture below the default partition cutoff
+static vector<double> findCuts(EM &em, bool isPeriodic) {
+    em.setSeed(7);
+    em.simpleRun(50);
+    vector<Param> params = em.getParams();
+    vector<double> minima = isPeriodic ?
+        MethodsPeriodicGaussian(params, 2*PI, 11).findMinima() :
+        MethodsGaussian(params, 11).findMinima();
+    vector<double> cuts;
+    for(int i=0; i < minima.size(); i++) {
+        double value = isPeriodic ? periodicGaussianMixture(params, minima[i], 2*PI) : gaussianMixture(params, minima[i]);
+        if(value < 0.01)
+            cuts.push_back(minima[i]);
+    }
+    sort(cuts.begin(), cuts.end());
+    return cuts;
+}
+
+// runs the same seeded EM with the kernels at accuracy A and with libm, and
+// bounds how far every cut moves
+template<FastMathAccuracy A> static void matchCuts(const vector<double> &data, bool isPeriodic, double bound) {
+    vector<double> fast;
+    vector<double> exact;
+    if(isPeriodic) {
+        EMPeriodicGaussianAt<A> approximate(data, 2*PI);
+        EMPeriodicGaussianAt<FAST_MATH_LIBM> reference(data, 2*PI);
+        fast = findCuts(approximate, true);
+        exact = findCuts(reference, true);
+    } else {
+        EMGaussianAt<A> approximate(data);
+        EMGaussianAt<FAST_MATH_LIBM> reference(data);
+        fast = findCuts(approximate, false);
+        exact = findCuts(reference, false);
+    }
+    if(exact.size() == 0 || fast.size() != exact.size()) {
+        stringstream msg;
+        msg << "matchCuts() - " << fast.size() << " cuts instead of " << exact.size();
+        throw(std::runtime_error(msg.str()));
+    }
+    for(int i=0; i < exact.size(); i++) {
+        if(fabs(fast[i]-exact[i]) > bound) {
+            stringstream msg;
+            msg << "matchCuts() - cut " << fast[i] << " is " << fabs(fast[i]-exact[i]) << " away from the libm cut";
+            throw(std::runtime_error(msg.str()));
+        }
+    }
+}
+
+// the three cluster periodic dataset of testCluster
+template<FastMathAccuracy A> void testPeriodicCuts(double bound) {
+    double means[3][2] = {{-PI/2, PI/2}, {-PI/2, -PI/2}, {PI/2, 0}};
+    double sigmas[2] = {0.3, 0.5};
+    vector<vector<double> > dims(2);
+    for(int c=0; c < 3; c++) {
+        for(int i=0; i < 1000; i++) {
+            for(int d=0; d < 2; d++) {
+                dims[d].push_back(periodicGaussianSample(means[c][d], sigmas[d], 2*PI));
+            }
+        }
+    }
+    for(int d=0; d < 2; d++) {
+        matchCuts<A>(dims[d], true, bound);
+    }
+}
+
+// the bimodal aperiodic dataset of testEMGaussian
+template<FastMathAccuracy A> void testAperiodicCuts(double bound) {
+    vector<Param> trueParams;
+    trueParams.push_back(Param(0.4, -3.4, 1.2));
+    trueParams.push_back(Param(0.6, 7.4, 2.2));
+    vector<double> data;
+    for(int i=0; i < 3000; i++) {
+        data.push_back(gaussianMixtureSample(trueParams));
+    }
+    matchCuts<A>(data, false, bound);
+}
+
+int main() {
+    try {
+        testExpAccuracy<FAST_MATH_1E6>(1e-6);
+        testExpAccuracy<FAST_MATH_1E12>(1e-12);
+
+        // cut locations may move by at most this much due to the kernel approximations
+        srand(1);
+        testPeriodicCuts<FAST_MATH_1E6>(1e-4);
+        srand(1);
+        testPeriodicCuts<FAST_MATH_1E12>(1e-7);
+        srand(1);
+        testAperiodicCuts<FAST_MATH_1E6>(1e-4);
+        srand(1);
+        testAperiodicCuts<FAST_MATH_1E12>(1e-7);
+        cout << "done" << endl;
+    } catch(const exception &e) {
+        cout << e.what() << endl;
+    }
+}
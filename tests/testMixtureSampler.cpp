@@ -0,0 +1,139 @@
+// tests sampling from gaussian and periodic gaussian mixtures
+
+#include <math.h>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <MixtureSampler.h>
+#include <Random.h>
+#include <MathFunctions.h>
+
+#include "util.h"
+
+using namespace std;
+using namespace Terran;
+
+// components are well separated, so the fraction of samples near each mean
+// recovers the component weights picked by the alias table
+void testComponentWeights() {
+    vector<Param> params;
+    params.push_back(Param(0.05, -20, 0.5));
+    params.push_back(Param(0.15,   0, 0.5));
+    params.push_back(Param(0.30,  20, 0.5));
+    params.push_back(Param(0.50,  40, 0.5));
+
+    MixtureSampler sampler(params);
+    sampler.setSeed(1);
+    const int numSamples = 1000000;
+    vector<double> counts(params.size(), 0);
+    for(int i=0; i < numSamples; i++) {
+        double x = sampler.sample();
+        for(int k=0; k < params.size(); k++) {
+            if(fabs(x-params[k].u) < 5) {
+                counts[k]++;
+            }
+        }
+    }
+    for(int k=0; k < params.size(); k++) {
+        if(fabs(counts[k]/numSamples-params[k].p) > 5e-3) {
+            stringstream msg;
+            msg << "testComponentWeights() - component " << k << " drawn with frequency " << counts[k]/numSamples;
+            throw(std::runtime_error(msg.str()));
+        }
+    }
+}
+
+void testGaussianMoments() {
+    vector<Param> params(1, Param(1.0, 3.2, 1.7));
+    MixtureSampler sampler(params);
+    sampler.setSeed(2);
+    vector<double> samples(1000000);
+    sampler.sample(samples);
+    double mean = 0;
+    for(int i=0; i < samples.size(); i++) {
+        mean += samples[i];
+    }
+    mean /= samples.size();
+    double var = 0;
+    for(int i=0; i < samples.size(); i++) {
+        var += (samples[i]-mean)*(samples[i]-mean);
+    }
+    var /= samples.size();
+    if(fabs(mean-3.2) > 1e-2 || fabs(sqrt(var)-1.7) > 1e-2) {
+        stringstream msg;
+        msg << "testGaussianMoments() - mean " << mean << " std " << sqrt(var);
+        throw(std::runtime_error(msg.str()));
+    }
+}
+
+// the mean resultant vector of a wrapped normal is exp(-s^2/2)*exp(iu),
+// this also checks that tiny standard deviations are handled exactly
+void testPeriodicMoments() {
+    double period = 2*PI;
+    double sigmas[] = {1e-5, 0.3, 1.5, 4.0};
+    for(int i=0; i < 4; i++) {
+        vector<Param> params(1, Param(1.0, 3.0, sigmas[i]));
+        MixtureSampler sampler(params, period);
+        sampler.setSeed(3);
+        const int numSamples = 500000;
+        double real = 0;
+        double imag = 0;
+        for(int n=0; n < numSamples; n++) {
+            double x = sampler.sample();
+            if(x < -PI || x > PI) {
+                throw(std::runtime_error("testPeriodicMoments() - sample outside of [-PI, PI]"));
+            }
+            real += cos(x);
+            imag += sin(x);
+        }
+        real /= numSamples;
+        imag /= numSamples;
+        double R = exp(-0.5*sigmas[i]*sigmas[i]);
+        if(fabs(real-R*cos(3.0)) > 5e-3 || fabs(imag-R*sin(3.0)) > 5e-3) {
+            stringstream msg;
+            msg << "testPeriodicMoments() - wrong resultant for s = " << sigmas[i];
+            throw(std::runtime_error(msg.str()));
+        }
+    }
+}
+
+void testReproducible() {
+    vector<Param> params;
+    params.push_back(Param(0.3, -1.0, 0.2));
+    params.push_back(Param(0.7,  1.0, 0.4));
+    MixtureSampler s1(params, 2*PI);
+    MixtureSampler s2(params, 2*PI);
+    s1.setSeed(1234);
+    s2.setSeed(1234);
+    for(int i=0; i < 1000; i++) {
+        if(s1.sample() != s2.sample()) {
+            throw(std::runtime_error("testReproducible() - equally seeded samplers differ"));
+        }
+    }
+}
+
+// the largest 64 bit draw must still pick a valid component
+void testLargestDraw() {
+    const double u = Random::toUniform(~0ULL);
+    if(!(u < 1) || Random::toUniform(0) != 0)
+        throw(std::runtime_error("testLargestDraw() - uniform draw outside [0, 1)"));
+    for(int count=1; count <= 100000; count++) {
+        if((int) (u*count) >= count)
+            throw(std::runtime_error("testLargestDraw() - component index out of range"));
+    }
+}
+
+int main() {
+    try {
+        testComponentWeights();
+        testGaussianMoments();
+        testPeriodicMoments();
+        testReproducible();
+        testLargestDraw();
+        cout << "done" << endl;
+    } catch(const exception &e) {
+        cout << e.what() << endl;
+    }
+}
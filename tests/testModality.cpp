@@ -0,0 +1,125 @@
+// tests the histogram multimodality score
+
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include <Modality.h>
+#include <MathFunctions.h>
+#include <PartitionerEM.h>
+
+using namespace std;
+using namespace Terran;
+
+// unimodal samples stay within the noise, two separated modes do not
+void testAperiodic() {
+    vector<double> unimodal;
+    vector<double> bimodal;
+    for(int i=0; i < 3000; i++) {
+        unimodal.push_back(gaussianSample(1, 2));
+        bimodal.push_back(gaussianSample(i % 2 ? -3 : 3, 0.8));
+    }
+    double low = multimodality(unimodal, false);
+    double high = multimodality(bimodal, false);
+    if(low > 4 || high < 10) {
+        stringstream msg;
+        msg << "testAperiodic() - wrong scores: " << low << " " << high;
+        throw(std::runtime_error(msg.str()));
+    }
+    if(multimodality(vector<double>(10, 1.0), false) != 0)
+        throw(std::runtime_error("testAperiodic() - constant data is not unimodal"));
+}
+
+// a mode wrapped around the boundary is one mode, not two
+void testPeriodic() {
+    vector<double> wrapped;
+    vector<double> bimodal;
+    for(int i=0; i < 3000; i++) {
+        wrapped.push_back(periodicGaussianSample(PI, 0.5, 2*PI));
+        bimodal.push_back(periodicGaussianSample(i % 2 ? -PI/2 : PI/2, 0.4, 2*PI));
+    }
+    double low = multimodality(wrapped, true);
+    double high = multimodality(bimodal, true);
+    if(low > 4 || high < 10 || multimodality(wrapped, false) < 10) {
+        stringstream msg;
+        msg << "testPeriodic() - wrong scores: " << low << " " << high;
+        throw(std::runtime_error(msg.str()));
+    }
+}
+
+// PartitionerEM skips the fit of unimodal data, but still cuts bimodal data
+void testScreening() {
+    vector<double> unimodal;
+    vector<double> bimodal;
+    for(int i=0; i < 3000; i++) {
+        unimodal.push_back(gaussianSample(0, 1));
+        bimodal.push_back(gaussianSample(i % 2 ? -3 : 3, 0.8));
+    }
+    PartitionerEM partitioner;
+    if(partitioner.getScreening())
+        throw(std::runtime_error("testScreening() - screening is on by default"));
+    partitioner.setScreening(true);
+    partitioner.setDataAndPeriod(unimodal, false);
+    if(partitioner.partition().size() != 0 || partitioner.getIterations() != 0)
+        throw(std::runtime_error("testScreening() - unimodal data was fitted"));
+    partitioner.setScreening(false);
+    partitioner.partition();
+    if(partitioner.getIterations() == 0)
+        throw(std::runtime_error("testScreening() - screening was not disabled"));
+    partitioner.setScreening(true);
+    partitioner.setDataAndPeriod(bimodal, false);
+    if(partitioner.partition().size() != 1)
+        throw(std::runtime_error("testScreening() - bimodal data was not cut"));
+}
+
+// a screened partition still has a model to evaluate: one component with the
+// mean and spread of the data. Data without spread has none.
+void testEvaluateScreened() {
+    vector<double> unimodal;
+    for(int i=0; i < 3000; i++) {
+        unimodal.push_back(gaussianSample(2, 1));
+    }
+    PartitionerEM partitioner;
+    partitioner.setScreening(true);
+    partitioner.setDataAndPeriod(unimodal, false);
+    partitioner.partition();
+    vector<double> x;
+    vector<double> y;
+    partitioner.evaluateModel(x, y, 100);
+    if(x.size() == 0 || x.size() != y.size())
+        throw(std::runtime_error("testEvaluateScreened() - no curve"));
+    const int peak = max_element(y.begin(), y.end())-y.begin();
+    if(fabs(x[peak]-2) > 0.3) {
+        stringstream msg;
+        msg << "testEvaluateScreened() - curve peaks at " << x[peak];
+        throw(std::runtime_error(msg.str()));
+    }
+
+    partitioner.setDataAndPeriod(vector<double>(10, 1.0), false);
+    partitioner.partition();
+    bool thrown = false;
+    try {
+        partitioner.evaluateModel(x, y, 100);
+    } catch(const std::runtime_error &) {
+        thrown = true;
+    }
+    if(!thrown)
+        throw(std::runtime_error("testEvaluateScreened() - constant data has a model"));
+}
+
+int main() {
+    try {
+        srand(1);
+        testAperiodic();
+        testPeriodic();
+        testScreening();
+        testEvaluateScreened();
+        cout << "done" << endl;
+    } catch(const exception &e) {
+        cout << e.what() << endl;
+    }
+}
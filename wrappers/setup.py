@@ -15,7 +15,7 @@ if new_compiler().compiler_type == 'msvc':
     compile_args = ['/openmp']
     link_args = ['']
 else:
-    compile_args = ['-fopenmp']
+    compile_args = ['-fopenmp', '-fno-trapping-math']
     link_args = ['-lgomp']
     
 ext_modules = [Extension('terran',
@@ -7,6 +7,7 @@
 
 from libcpp cimport bool
 from libcpp.vector cimport vector
+from libcpp.string cimport string
 
 # Abstract Class
 cdef extern from "../include/Partitioner.h" namespace "Terran":
@@ -24,6 +25,10 @@ cdef extern from "../include/PartitionerEM.h" namespace "Terran":
         double getPartitionCutoff()
         void setInitialK(int count)
         int getInitialK()
+        void setScreening(bool enabled)
+        bool getScreening()
+        void setScreeningTolerance(double tolerance)
+        double getScreeningTolerance()
 
 cdef class PyPartitionerEM:
     
@@ -67,6 +72,21 @@ cdef class PyPartitionerEM:
         """
         def __get__(self): return self.__thisptr.getInitialK()
         def __set__(self, int k): self.__thisptr.setInitialK(k)
+
+    property screening:
+        """
+        Mutable: if True, data without a histogram valley deeper than screening_tolerance
+        standard deviations is not fitted and gets no cut. Off by default.
+        """
+        def __get__(self): return self.__thisptr.getScreening()
+        def __set__(self, bool enabled): self.__thisptr.setScreening(enabled)
+
+    property screening_tolerance:
+        """
+        Mutable: depth in standard deviations a histogram valley must exceed to run EM
+        """
+        def __get__(self): return self.__thisptr.getScreeningTolerance()
+        def __set__(self, double t): self.__thisptr.setScreeningTolerance(t)
     
     
 cdef extern from "../include/Cluster.h" namespace "Terran":
@@ -187,6 +207,17 @@ cdef class PyCluster:
             yield d
             d += 1
             
+cdef extern from "../include/ClusterTree.h" namespace "Terran::ClusterTree":
+    cdef enum Priority:
+        LARGEST_FIRST
+        HIGHEST_VARIANCE_FIRST
+    cdef cppclass Budget:
+        Budget()
+        double seconds
+        int nodes
+        long long iterations
+        Priority priority
+
 cdef extern from "../include/ClusterTree.h" namespace "Terran":
     cdef cppclass ClusterTree:
         ClusterTree(vector[vector[double]],vector[int]) except +
@@ -200,6 +231,15 @@ cdef extern from "../include/ClusterTree.h" namespace "Terran":
         # exceptions temporarily disabled for getCurrentCluster due to cython bug
         Cluster& getCurrentCluster()
         void divideCurrentCluster(int) except +
+        bint build(Budget) except +
+        void setMinSplitSize(int) except +
+        int getMinSplitSize()
+        void setMaxSplits(int)
+        int getMaxSplits()
+        void save(string, bint) except +
+        int insert(vector[vector[double]]) except +
+        void setDriftTolerance(double) except +
+        double getDriftTolerance()
          
 cdef class PyClusterTree:
     
@@ -253,7 +293,56 @@ cdef class PyClusterTree:
         """
 
         self.__thisptr.divideCurrentCluster(cutoff)
+
+    def build(self, int cutoff=3000, double seconds=0, int nodes=0, long long iterations=0, variance_first=False, int max_splits=0):
+        """
+        Process the queued clusters and their descendants until the queue is empty or the budget
+        runs out, and return True if the queue was emptied. Clusters with more than cutoff points
+        are divided further. Independent clusters are partitioned in parallel, and without a budget
+        the resulting tree is the same as the one found by repeatedly calling set_current_cluster,
+        partitioning every dimension and calling divide_current_cluster(cutoff).
+
+        Arguments:
+        seconds         -- wall clock budget, 0 for unlimited
+        nodes           -- maximum number of clusters to partition, 0 for unlimited
+        iterations      -- maximum number of EM iterations summed over clusters, 0 for unlimited
+        variance_first  -- with a budget, divide the clusters of highest variance first
+                           instead of the largest ones
+        max_splits      -- stop partitioning the dimensions of a cluster, most multimodal first,
+                           once this many of them split it. 0 partitions every dimension
+        """
+        cdef Budget budget
+        budget.seconds = seconds
+        budget.nodes = nodes
+        budget.iterations = iterations
+        budget.priority = HIGHEST_VARIANCE_FIRST if variance_first else LARGEST_FIRST
+        self.__thisptr.setMinSplitSize(cutoff)
+        self.__thisptr.setMaxSplits(max_splits)
+        return self.__thisptr.build(budget)
+
+    def save(self, filename, permutation=True):
+        """
+        Write the tree, its cut points and its queued clusters to a compact binary file.
+        Without the permutation the file is smaller but cannot be used to resume the build.
+        """
+        self.__thisptr.save(filename.encode(), permutation)
         
+    def insert(self, vector[vector[double]] points):
+        """
+        Add points to the tree, routing each through the existing cuts to a leaf. Leaves that grew
+        past the split size, or whose marginals drifted by more than drift_tolerance standard errors,
+        are divided again, and the number of such leaves is returned. Cluster numbers may change.
+        """
+        return self.__thisptr.insert(points)
+
+    property drift_tolerance:
+        """
+        Mutable: standard errors a feature mean of a leaf's inserted points may move before insert
+        divides the leaf again
+        """
+        def __get__(self): return self.__thisptr.getDriftTolerance()
+        def __set__(self, double val): self.__thisptr.setDriftTolerance(val)
+
     property clusters_found:
         """
         Immutable: return number of clusters found so far